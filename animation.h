@@ -16,7 +16,20 @@
 
 #include <array>
 #include <vector>
-#include <map>
+#include <memory_resource>
+#include <algorithm>
+
+#include "flat_hash_map.h"
+#include "name_table.h"
+#include "collision_mask.h"
+#include "rle_image.h"
+#include "tinf/tdeflate.h"
+
+namespace aseprite {
+class Decompressor;
+class DecoderContext;
+class LoadStats;
+}
 
 namespace animation{
 
@@ -26,24 +39,87 @@ enum class LoopType {
     PING_PONG
 };
 
+/**
+ * a * b / 255 rounded, combines opacities and premultiplies colors.
+ */
+inline uint8_t multiplyOpacity(uint8_t a, uint8_t b) {
+    return (a * b + 127) / 255;
+}
+
 struct Color {
     uint8_t r;
     uint8_t g;
     uint8_t b;
     uint8_t a = 255;
+
+    bool operator ==(const Color & c) const {
+        return r == c.r && g == c.g && b == c.b && a == c.a;
+    }
+
+    bool operator !=(const Color & c) const {
+        return !(*this == c);
+    }
 };
 
 class Palette {
 public:
     std::array<Color, 256> colors;
+
+    bool operator ==(const Palette & p) const {
+        return colors == p.colors;
+    }
+
+    bool operator !=(const Palette & p) const {
+        return colors != p.colors;
+    }
+
+    /**
+     * Multiplies colors by their alpha.
+     */
+    void premultiply() {
+        for (auto & c : colors) {
+            c.r = multiplyOpacity(c.r, c.a);
+            c.g = multiplyOpacity(c.g, c.a);
+            c.b = multiplyOpacity(c.b, c.a);
+        }
+    }
+};
+
+/**
+ * Byte order of expanded 32 bit pixels, premultiplied layouts have colors multiplied by alpha.
+ */
+enum class PixelLayout {
+    RGBA8,
+    BGRA8,
+    RGBA8_PREMULTIPLIED,
+    BGRA8_PREMULTIPLIED
 };
 
+/**
+ * Palette converted to 32 bit pixels of one layout, with opacity applied and the transparent
+ * index cleared. Build it once per palette and use it for all images expanded with it.
+ * Palettes of an Animation::premultiplied are already premultiplied, use RGBA8 or BGRA8 and
+ * opacity 255 for them.
+ */
+class PaletteLookup {
+public:
+    std::array<uint32_t, 256> pixels; // in memory the bytes are in the order of the layout
+
+    PaletteLookup(const Palette & palette, PixelLayout layout = PixelLayout::RGBA8,
+                  uint8_t opacity = 255, uint8_t transparentIndex = 0);
+};
+
+/**
+ * Indexed image of a cel. Animation::rleImages, when filled, hold the same pixels as runs.
+ * With LoadOptions::rleOnly the runs are the only copy and pixels is empty, only the size is
+ * kept, use Animation::decodedImage for the pixels.
+ */
 class Image {
 public:
     uint16_t width = 0;
     uint16_t height = 0;
 
-    std::vector<uint8_t> pixels; // TOOD 32bit color images
+    std::vector<uint8_t> pixels; // width * height palette indices, empty with LoadOptions::rleOnly. TOOD 32bit color images
 
     Image() = default;
 
@@ -79,7 +155,34 @@ public:
         return *this;
     }
 
+    /**
+     * False for an image of an animation loaded with LoadOptions::rleOnly.
+     */
+    bool hasPixels() const {
+        return pixels.size() == static_cast<size_t>(width) * height;
+    }
+
+    /**
+     * Writes width * height 32 bit pixels to destination, rows pitch bytes apart (e.g. a mapped
+     * texture or staging buffer), every pixel is written once. An image without its pixels
+     * asserts and returns false with nothing written, expand Animation::decodedImage() instead.
+     */
+    bool expand(const PaletteLookup & lookup, void * destination, size_t pitch) const;
+
+    bool expand(const Palette & palette, void * destination, size_t pitch, PixelLayout layout = PixelLayout::RGBA8,
+                uint8_t opacity = 255, uint8_t transparentIndex = 0) const {
+        return expand(PaletteLookup(palette, layout, opacity, transparentIndex), destination, pitch);
+    }
+
+    /**
+     * Colors of the pixels. An image without its pixels asserts and gives no colors, substitute
+     * Animation::decodedImage() instead.
+     */
     std::vector<Color> substitute(const Palette& palette, uint8_t opacity = 255, uint8_t transparentIndex = 0) const {
+        assert(hasPixels());
+        if (!hasPixels()) {
+            return std::vector<Color>();
+        }
         size_t size = pixels.size();
         std::vector<Color> result(size);
 
@@ -99,10 +202,22 @@ public:
 
 class Cel {
 public:
+    static constexpr uint32_t NO_IMAGE = UINT32_MAX;
+
     int16_t x = 0;
     int16_t y = 0;
     uint8_t opacity = 0;
-    uint32_t image; //pointer to animation.images
+    uint32_t image = NO_IMAGE; //pointer to animation.images, NO_IMAGE for an empty cel
+};
+
+/**
+ * Cel of a frame in Animation::frameCels.
+ */
+class FrameCel {
+public:
+    uint32_t layer; // index to animation.layers
+    Cel cel;
+    uint8_t opacity; // of the cel, its layer and the groups above, as in the file
 };
 
 class Frame {
@@ -134,8 +249,41 @@ public:
         NinePatch ninePatch;
         Pivot pivot;
     };
+    static constexpr uint32_t NO_KEY = UINT32_MAX;
+
     std::string name;
-    std::vector<Key> sliceKeys;
+    std::vector<Key> sliceKeys; // sorted by frame
+    std::vector<uint32_t> frameKeys; // frame -> index to sliceKeys, NO_KEY before the first key
+
+    /**
+     * Builds the dense frame -> key table used by getKey().
+     */
+    void buildKeyIndex(uint32_t framesCount) {
+        frameKeys.assign(framesCount, NO_KEY);
+        uint32_t key = NO_KEY;
+        size_t next = 0;
+        for (uint32_t f = 0; f < framesCount; f++) {
+            while (next < sliceKeys.size() && sliceKeys[next].frame <= f) {
+                key = next++;
+            }
+            frameKeys[f] = key;
+        }
+    }
+
+    /**
+     * Key in effect for given frame, a key is valid from its frame until the next key.
+     * nullptr if the slice has no key on or before the frame.
+     */
+    const Key * getKey(uint32_t frame) const {
+        if (frame < frameKeys.size()) {
+            uint32_t key = frameKeys[frame];
+            return key == NO_KEY ? nullptr : &sliceKeys[key];
+        }
+        // no index (or frame past its end), binary search the keys
+        auto it = std::upper_bound(sliceKeys.begin(), sliceKeys.end(), frame,
+            [](uint32_t frame, const Key & key) { return frame < key.frame; });
+        return it == sliceKeys.begin() ? nullptr : &*(it - 1);
+    }
 };
 
 
@@ -144,11 +292,14 @@ public:
     class LayerView {
     public:
         bool visible = true;
+        uint8_t opacity = 255;
 
         LayerView(const Layer & l) :
-            visible(l.visible) {
+            visible(l.visible),
+            opacity(l.opacity) {
         }
     };
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
     enum BLEND_MODE {
         Normal = 0,
         Multiply = 1,
@@ -175,6 +326,9 @@ public:
     bool visible = true;
     bool isGroupLayer = false; // true -> no frames
     uint8_t opacity;
+    uint16_t childLevel = 0; // depth in the layer tree, children follow their group
+    uint32_t parent = NO_PARENT; // index of the group layer containing this one
+    uint32_t subtreeEnd = 0; // index past the last descendant, see Animation::buildLayerTree
     std::string name;
     std::vector<Cel> frames;
     Layer(BLEND_MODE blendMode, bool visible, bool isGroupLayer,
@@ -196,6 +350,9 @@ public:
         visible(l.visible),
         isGroupLayer(l.isGroupLayer),
         opacity(l.opacity),
+        childLevel(l.childLevel),
+        parent(l.parent),
+        subtreeEnd(l.subtreeEnd),
         name(l.name),
         frames(l.frames) {
     }
@@ -205,7 +362,10 @@ public:
         visible(l.visible),
         isGroupLayer(l.isGroupLayer),
         opacity(l.opacity),
-        name(l.name),
+        childLevel(l.childLevel),
+        parent(l.parent),
+        subtreeEnd(l.subtreeEnd),
+        name(std::move(l.name)),
         frames(std::move(l.frames)) {
     }
 
@@ -214,6 +374,9 @@ public:
         visible = l.visible;
         isGroupLayer = l.isGroupLayer;
         opacity = l.opacity;
+        childLevel = l.childLevel;
+        parent = l.parent;
+        subtreeEnd = l.subtreeEnd;
         name = l.name;
         frames = l.frames;
         return *this;
@@ -224,7 +387,10 @@ public:
         visible = l.visible;
         isGroupLayer = l.isGroupLayer;
         opacity = l.opacity;
-        name = l.name;
+        childLevel = l.childLevel;
+        parent = l.parent;
+        subtreeEnd = l.subtreeEnd;
+        name = std::move(l.name);
         frames = std::move(l.frames);
         return *this;
     }
@@ -245,39 +411,125 @@ public:
     }
 };
 
+class LoadOptions {
+public:
+    const aseprite::Decompressor * decompressor = nullptr; // nullptr -> bundled tinf
+    bool collisionMasks = false; // fill Animation::masks
+    uint8_t maskAlphaThreshold = 1; // RGBA and grayscale sprites: pixels with lower alpha are not solid
+    aseprite::LoadStats * stats = nullptr; // per phase times and counts of the load, see load_stats.h
+    std::pmr::memory_resource * memory = nullptr; // parser data, nullptr -> arena of the context
+    aseprite::DecoderContext * context = nullptr; // buffers reused across loads, nullptr -> aseprite::threadDecoderContext()
+    bool celChecksums = false; // fill Animation::imageChecksums, lets reloadAseImage skip unchanged cels
+    bool premultipliedAlpha = false; // palette colors multiplied by alpha, the transparent index all zero
+    bool rleImages = false; // fill Animation::rleImages, kept next to Image::pixels (more memory) unless rleOnly
+    bool rleOnly = false; // with rleImages: drop Image::pixels, the runs are the only copy (smaller for sparse sprites)
+};
+
 class Animation {
 public:
 
+    /**
+     * Visibility and opacity of layers for one user of a shared animation. Effective values
+     * (the layer's own combined with all groups above it) are cached per layer, changing a layer
+     * updates only its subtree.
+     */
     class AnimationView {
     public:
+        class EffectiveLayer {
+        public:
+            bool visible;
+            uint8_t opacity; // own opacity multiplied by opacities of the groups above
+        };
+
         const Animation & animation;
-        std::vector<Layer::LayerView> layerViews;
+        std::vector<Layer::LayerView> layerViews; // as set, call refresh() after changing them directly
+        std::vector<EffectiveLayer> effectiveLayers;
+        const Palette * palette = nullptr; // variant used instead of the palettes of the animation
+        uint32_t generation; // Animation::generation the view was made for
     public:
         AnimationView(const Animation & animation) :
             animation(animation),
-            layerViews(animation.layers.begin(), animation.layers.end()) {
+            layerViews(animation.layers.begin(), animation.layers.end()),
+            effectiveLayers(animation.layers.size()),
+            generation(animation.generation) {
+            refresh();
         }
 
-        int getLayerId(const std::string & name) {
-            for (uint32_t i = 0; i < layerViews.size(); i++) {
-                if (animation.layers[i].name == name) {
-                    return i;
-                }
+        /**
+         * The layer and all groups above it are visible.
+         */
+        bool isLayerVisible(int layerId) const {
+            return effectiveLayers[layerId].visible;
+        }
+
+        uint8_t getLayerOpacity(int layerId) const {
+            return effectiveLayers[layerId].opacity;
+        }
+
+        /**
+         * Draws the shared images with another palette (team colors, palette cycling),
+         * nullptr -> palettes of the animation. The palette must outlive its use by the view.
+         */
+        void setPalette(const Palette * variant) {
+            palette = variant;
+        }
+
+        const Palette & getPalette(uint32_t frame) const {
+            return palette ? *palette : animation.getFramePalette(frame);
+        }
+
+        /**
+         * Recomputes all effective values.
+         */
+        void refresh() {
+            update(0, layerViews.size());
+        }
+
+        int getLayerId(NameHandle name) const {
+            return animation.getLayerId(name);
+        }
+
+        int getLayerId(const std::string & name) const {
+            return animation.getLayerId(name);
+        }
+
+        void setLayerVisibilityById(int layerId, bool visible) {
+            layerViews[layerId].visible = visible;
+            update(layerId, animation.layers[layerId].subtreeEnd);
+        }
+
+        void setLayerVisibility(NameHandle name, bool visible) {
+            int index = getLayerId(name);
+            if(index != -1){
+                setLayerVisibilityById(index, visible);
             }
-            return -1;
         }
 
         void setLayerVisibility(const std::string & name, bool visible) {
+            setLayerVisibility(animation.getName(name), visible);
+        }
+
+        void setLayerOpacityById(int layerId, uint8_t opacity) {
+            layerViews[layerId].opacity = opacity;
+            update(layerId, animation.layers[layerId].subtreeEnd);
+        }
+
+        void setLayerOpacity(NameHandle name, uint8_t opacity) {
             int index = getLayerId(name);
             if(index != -1){
-                layerViews[index].visible = visible;
+                setLayerOpacityById(index, opacity);
             }
         }
 
+        void setLayerOpacity(const std::string & name, uint8_t opacity) {
+            setLayerOpacity(animation.getName(name), opacity);
+        }
+
         void setVisibilityForAllLayers(bool visible) {
             for (auto & view : layerViews) {
                 view.visible = visible;
             }
+            refresh();
         }
 
         void hideAllLayers() {
@@ -288,36 +540,80 @@ public:
             setVisibilityForAllLayers(true);
         }
 
+    private:
+        // layers [first, end), a group comes before its children so their parents are already updated
+        void update(size_t first, size_t end) {
+            for (size_t l = first; l < end; l++) {
+                const auto & view = layerViews[l];
+                EffectiveLayer effective{view.visible, view.opacity};
+                uint32_t parent = animation.layers[l].parent;
+                if (parent != Layer::NO_PARENT) {
+                    const auto & group = effectiveLayers[parent];
+                    effective.visible = effective.visible && group.visible;
+                    effective.opacity = multiplyOpacity(effective.opacity, group.opacity);
+                }
+                effectiveLayers[l] = effective;
+            }
+        }
     };
 
     uint16_t width;
     uint16_t height;
     uint16_t framesCount;
     uint8_t transparentIndex;
-    Palette palette;
+    bool premultiplied = false; // colors of the palettes are multiplied by alpha, see LoadOptions::premultipliedAlpha
+    Palette palette; // of the first frame
+    std::vector<Palette> palettes; // distinct palettes of the frames, empty if the palette never changes
+    std::vector<uint16_t> framePalettes; // frame -> index to palettes, empty if palettes is
     std::vector<std::vector<int32_t>> animations;
     std::vector<Frame> frames;
     std::vector<Layer> layers;
     std::vector<Image> images;
+    std::vector<CollisionMask> masks; // parallel to images, empty unless LoadOptions::collisionMasks
+    uint8_t maskAlphaThreshold = 0; // LoadOptions::maskAlphaThreshold the masks were made with
+    std::vector<uint64_t> imageChecksums; // parallel to images, 0 for raw cels, empty unless LoadOptions::celChecksums
+    std::vector<RleImage> rleImages; // parallel to images, empty unless LoadOptions::rleImages
+    bool rleOnly = false; // images have no pixels, only their size, see LoadOptions::rleOnly
+    uint32_t generation = 0; // incremented by reloadAseImage, views of an older generation are stale
     std::vector<Loop> loops;
     std::vector<Slice> slices;
-    std::map<std::string, size_t> animationLookup; //index to animations
-    std::map<std::string, size_t> sliceLookup; //index to slices
+    std::vector<FrameCel> frameCels; // cels with an image, by frame and in draw order, see getFrameCels
+    std::vector<uint32_t> frameCelsStart; // frame -> first index to frameCels, framesCount + 1 entries
+    NameTable names; // interned names of loops, slices and layers
+    FlatHashMap<NameHandle, size_t> animationLookup; //index to animations
+    FlatHashMap<NameHandle, size_t> sliceLookup; //index to slices
+    FlatHashMap<NameHandle, size_t> layerLookup; //index to layers, first layer of given name
+
+    /**
+     * Handle of an interned name, NO_NAME if the animation has no loop, slice or layer called so.
+     * Resolve names once and use the handles in per tick code.
+     */
+    NameHandle getName(const std::string & name) const {
+        return names.find(name);
+    }
 
+    bool hasAnimation(NameHandle animationName) const {
+        return animationLookup.contains(animationName);
+    }
 
-    bool hasAnimation(const std::string & animationName) {
-        return animationLookup.count(animationName) > 0;
+    bool hasAnimation(const std::string & animationName) const {
+        return hasAnimation(getName(animationName));
     }
 
-    const std::vector<int32_t> & getAnimation(const std::string & animationName) const {
-        const auto & it = animationLookup.find(animationName);
-        if(it == animationLookup.end()){
+    const std::vector<int32_t> & getAnimation(NameHandle animationName) const {
+        const size_t * index = animationLookup.find(animationName);
+        if(index == nullptr){
             assert(animations.size() > 0);
             return animations[0];
         } else {
-            return animations[it->second];
+            return animations[*index];
         }
     }
+
+    const std::vector<int32_t> & getAnimation(const std::string & animationName) const {
+        return getAnimation(getName(animationName));
+    }
+
     void log() {
 //        std::cout << "Animation: frames:" << framesCount << " width: " << width << " height: " << height << "\n";
 //        std::cout << "  layers: \n";
@@ -325,25 +621,218 @@ public:
 //            std::cout << " name: " << layer.name << " " << (layer.isGroupLayer ? "[G]" : "") << "\n";
 //        }
     }
-    bool hasSlice(const std::string & sliceName) {
-        return sliceLookup.count(sliceName) > 0;
+
+    /**
+     * Image with all its pixels, decoded from the runs when only those are kept.
+     */
+    Image decodedImage(size_t image) const {
+        return rleOnly ? rleImages[image].decode(transparentIndex) : images[image];
     }
 
-    const Slice & getSlice(const std::string & sliceName) const {
-        const auto & it = sliceLookup.find(sliceName);
-        if(it == sliceLookup.end()){
+    /**
+     * Palette in effect for given frame, a file can change colors in any frame.
+     */
+    const Palette & getFramePalette(uint32_t frame) const {
+        return frame < framePalettes.size() ? palettes[framePalettes[frame]] : palette;
+    }
+
+    bool hasSlice(NameHandle sliceName) const {
+        return sliceLookup.contains(sliceName);
+    }
+
+    bool hasSlice(const std::string & sliceName) const {
+        return hasSlice(getName(sliceName));
+    }
+
+    const Slice & getSlice(NameHandle sliceName) const {
+        const size_t * index = sliceLookup.find(sliceName);
+        if(index == nullptr){
             assert(slices.size() > 0);
             return slices[0];
         } else {
-            return slices[it->second];
+            return slices[*index];
+        }
+    }
+
+    const Slice & getSlice(const std::string & sliceName) const {
+        return getSlice(getName(sliceName));
+    }
+
+    /**
+     * Key of the slice in effect for given frame, nullptr if the slice doesn't exist or has no key yet.
+     */
+    const Slice::Key * getSliceKey(NameHandle sliceName, uint32_t frame) const {
+        const size_t * index = sliceLookup.find(sliceName);
+        return index == nullptr ? nullptr : slices[*index].getKey(frame);
+    }
+
+    const Slice::Key * getSliceKey(const std::string & sliceName, uint32_t frame) const {
+        return getSliceKey(getName(sliceName), frame);
+    }
+
+    int getLayerId(NameHandle layerName) const {
+        const size_t * index = layerLookup.find(layerName);
+        return index == nullptr ? -1 : *index;
+    }
+
+    int getLayerId(const std::string & layerName) const {
+        return getLayerId(getName(layerName));
+    }
+
+    /**
+     * Pixel perfect test of two cels of sprites at given positions, requires masks.
+     */
+    bool celsOverlap(const Cel & cel, int32_t x, int32_t y,
+                     const Animation & other, const Cel & otherCel, int32_t otherX, int32_t otherY) const {
+        assert(cel.image < masks.size() && otherCel.image < other.masks.size());
+        return overlaps(masks[cel.image], x + cel.x, y + cel.y,
+                        other.masks[otherCel.image], otherX + otherCel.x, otherY + otherCel.y);
+    }
+
+    /**
+     * Contiguous range of FrameCels.
+     */
+    class FrameCels {
+    public:
+        const FrameCel * first;
+        const FrameCel * last;
+
+        const FrameCel * begin() const {
+            return first;
+        }
+
+        const FrameCel * end() const {
+            return last;
+        }
+
+        size_t size() const {
+            return last - first;
+        }
+
+        bool empty() const {
+            return first == last;
         }
+    };
+
+    /**
+     * Cels to draw for given frame, bottom layer first, layers without an image in the frame are left out.
+     * Visibility of layers is not applied. FrameCel::opacity has the opacities of the file, with
+     * an AnimationView combine Cel::opacity and AnimationView::getLayerOpacity instead.
+     */
+    FrameCels getFrameCels(uint32_t frame) const {
+        if (frame + 1 >= frameCelsStart.size()) {
+            return FrameCels{nullptr, nullptr};
+        }
+        const FrameCel * cels = frameCels.data();
+        return FrameCels{cels + frameCelsStart[frame], cels + frameCelsStart[frame + 1]};
+    }
+
+    /**
+     * Sets Layer::parent and subtreeEnd from the child levels, children follow their group layer.
+     */
+    void buildLayerTree() {
+        std::vector<uint32_t> groups; // open groups, innermost last
+        for (uint32_t l = 0; l < layers.size(); l++) {
+            auto & layer = layers[l];
+            while (!groups.empty() && layers[groups.back()].childLevel >= layer.childLevel) {
+                layers[groups.back()].subtreeEnd = l;
+                groups.pop_back();
+            }
+            layer.parent = groups.empty() ? Layer::NO_PARENT : groups.back();
+            layer.subtreeEnd = l + 1;
+            if (layer.isGroupLayer) {
+                groups.push_back(l);
+            }
+        }
+        for (uint32_t group : groups) {
+            layers[group].subtreeEnd = layers.size();
+        }
+    }
+
+    /**
+     * Builds frameCels from the cels of the layers, needed again after changing them.
+     */
+    void buildFrameCels() {
+        std::vector<uint8_t> layerOpacity(layers.size());
+        for (size_t l = 0; l < layers.size(); l++) {
+            uint32_t parent = layers[l].parent;
+            layerOpacity[l] = parent == Layer::NO_PARENT ? layers[l].opacity
+                : multiplyOpacity(layers[l].opacity, layerOpacity[parent]);
+        }
+        frameCels.clear();
+        frameCelsStart.assign(framesCount + 1, 0);
+        for (uint32_t f = 0; f < framesCount; f++) {
+            frameCelsStart[f] = frameCels.size();
+            for (uint32_t l = 0; l < layers.size(); l++) {
+                const auto & cels = layers[l].frames;
+                if (f < cels.size() && cels[f].image != Cel::NO_IMAGE) {
+                    frameCels.push_back(FrameCel{l, cels[f], multiplyOpacity(cels[f].opacity, layerOpacity[l])});
+                }
+            }
+        }
+        frameCelsStart[framesCount] = frameCels.size();
+    }
+
+    /**
+     * Estimate of the memory used by the animation: the object and everything its members own.
+     */
+    size_t memoryFootprint() const {
+        size_t bytes = sizeof(Animation);
+        for (const auto & image : images) {
+            bytes += vectorBytes(image.pixels);
+        }
+        for (const auto & mask : masks) {
+            bytes += vectorBytes(mask.bits);
+        }
+        for (const auto & rle : rleImages) {
+            bytes += vectorBytes(rle.runs) + vectorBytes(rle.rowStart);
+        }
+        for (const auto & layer : layers) {
+            bytes += vectorBytes(layer.frames) + layer.name.capacity();
+        }
+        for (const auto & slice : slices) {
+            bytes += vectorBytes(slice.sliceKeys) + vectorBytes(slice.frameKeys) + slice.name.capacity();
+        }
+        for (const auto & loop : loops) {
+            bytes += loop.name.capacity();
+        }
+        for (const auto & frames : animations) {
+            bytes += vectorBytes(frames);
+        }
+        bytes += vectorBytes(images) + vectorBytes(masks) + vectorBytes(rleImages) + vectorBytes(layers)
+            + vectorBytes(slices) + vectorBytes(loops) + vectorBytes(animations);
+        bytes += vectorBytes(palettes) + vectorBytes(framePalettes) + vectorBytes(frames)
+            + vectorBytes(imageChecksums) + vectorBytes(frameCels) + vectorBytes(frameCelsStart);
+        bytes += names.memoryFootprint() + animationLookup.memoryFootprint()
+            + sliceLookup.memoryFootprint() + layerLookup.memoryFootprint();
+        return bytes;
     }
 
     AnimationView toView() const {
         return AnimationView(*this);
     }
 
-    static animation::Animation loadAseImage(const std::string &path);
+    static animation::Animation loadAseImage(const std::string &path, const LoadOptions & options = LoadOptions());
+
+    /**
+     * Reads the file again and patches this animation in place. Cels whose compressed data
+     * matches imageChecksums keep their image without being inflated, indices of images still
+     * in use don't change, slots of dropped images are reused by new ones. Everything else
+     * (frames, layers, cels, loops, slices, palette) is replaced.
+     * Checksums are filled for the next reload. On a read error nothing changes and false is returned.
+     */
+    bool reloadAseImage(const std::string &path, const LoadOptions & options = LoadOptions());
+
+    /**
+     * Writes an indexed .aseprite file, cels compressed with given tdeflate level.
+     */
+    bool saveAseImage(const std::string &path, int level = TDEFLATE_DEFAULT_LEVEL) const;
+
+private:
+    template <typename T>
+    static size_t vectorBytes(const std::vector<T> & vector) {
+        return vector.capacity() * sizeof(T);
+    }
 };
 
 }
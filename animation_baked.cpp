@@ -0,0 +1,494 @@
+/*
+ * Baked animation - binary format of a converted Animation
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include "animation_baked.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define ANIMATION_BAKED_MMAP
+#endif
+
+namespace animation {
+
+// the baked file stores these types as they are in memory
+static_assert(sizeof(Color) == 4);
+static_assert(sizeof(Palette) == 256 * sizeof(Color));
+static_assert(sizeof(Frame) == 2);
+static_assert(sizeof(Cel) == 12);
+static_assert(sizeof(Slice::Key) == 44);
+static_assert(std::is_trivially_copyable_v<Slice::Key>);
+
+namespace baked {
+
+uint64_t hash(std::string_view name) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (char c : name) {
+        h = (h ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+constexpr size_t SECTION_ALIGNMENT = 64;
+constexpr size_t PIXEL_ALIGNMENT = 16;
+
+class Writer {
+public:
+    std::vector<uint8_t> data;
+    std::string strings;
+
+    void align(size_t alignment) {
+        data.resize((data.size() + alignment - 1) / alignment * alignment);
+    }
+
+    template <typename T>
+    uint64_t append(const T * values, size_t count, size_t alignment) {
+        align(alignment);
+        uint64_t offset = data.size();
+        data.resize(offset + count * sizeof(T));
+        if (count) {
+            std::memcpy(data.data() + offset, values, count * sizeof(T));
+        }
+        return offset;
+    }
+
+    template <typename T>
+    void section(SECTION s, const std::vector<T> & values) {
+        Section section;
+        section.offset = append(values.data(), values.size(), SECTION_ALIGNMENT);
+        section.size = values.size() * sizeof(T);
+        std::memcpy(data.data() + offsetof(BakedHeader, sections) + s * sizeof(Section), &section, sizeof(section));
+    }
+
+    BakedString string(const std::string & s) {
+        BakedString result{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(s.size())};
+        strings += s;
+        return result;
+    }
+
+    std::vector<BakedLookup> lookup(const FlatHashMap<NameHandle, size_t> & map, const NameTable & names) {
+        std::vector<BakedLookup> result;
+        map.forEach([&](NameHandle name, size_t index) {
+            BakedLookup l;
+            std::memset(&l, 0, sizeof(l));
+            l.hash = hash(names.name(name));
+            l.name = string(names.name(name));
+            l.index = index;
+            result.push_back(l);
+        });
+        std::sort(result.begin(), result.end(), [](const auto & a, const auto & b) { return a.hash < b.hash; });
+        return result;
+    }
+};
+
+}
+
+using namespace baked;
+
+bool writeBaked(const Animation & animation, const std::string & path) {
+    Writer w;
+    BakedHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.endianTag = ENDIAN_TAG;
+    header.width = animation.width;
+    header.height = animation.height;
+    header.framesCount = animation.framesCount;
+    header.transparentIndex = animation.transparentIndex;
+    header.flags = animation.premultiplied ? FLAG_PREMULTIPLIED : 0;
+    w.append(&header, 1, 1);
+
+    std::vector<Palette> palettes{animation.palette};
+    palettes.insert(palettes.end(), animation.palettes.begin(), animation.palettes.end());
+    std::vector<uint16_t> framePalettes;
+    for (uint16_t index : animation.framePalettes) {
+        framePalettes.push_back(index + 1);
+    }
+    w.section(PALETTE, palettes);
+    w.section(FRAMES, animation.frames);
+    w.section(FRAME_PALETTES, framePalettes);
+
+    std::vector<BakedLayer> layers;
+    std::vector<Cel> cels;
+    for (const auto & layer : animation.layers) {
+        BakedLayer l;
+        std::memset(&l, 0, sizeof(l));
+        l.name = w.string(layer.name);
+        l.firstCel = layer.isGroupLayer ? UINT32_MAX : cels.size();
+        l.blendMode = layer.blendMode;
+        l.visible = layer.visible;
+        l.isGroupLayer = layer.isGroupLayer;
+        l.opacity = layer.opacity;
+        l.childLevel = layer.childLevel;
+        layers.push_back(l);
+        if (!layer.isGroupLayer) {
+            size_t first = cels.size();
+            cels.resize(first + animation.framesCount); // value initialized, no garbage in padding
+            for (uint16_t f = 0; f < animation.framesCount && f < layer.frames.size(); f++) {
+                Cel & c = cels[first + f];
+                c.x = layer.frames[f].x;
+                c.y = layer.frames[f].y;
+                c.opacity = layer.frames[f].opacity;
+                c.image = layer.frames[f].image;
+            }
+        }
+    }
+    w.section(LAYERS, layers);
+    w.section(CELS, cels);
+
+    std::vector<BakedLoop> loops;
+    for (const auto & loop : animation.loops) {
+        BakedLoop l;
+        std::memset(&l, 0, sizeof(l));
+        l.name = w.string(loop.name);
+        l.from = loop.from;
+        l.to = loop.to;
+        l.loopType = static_cast<uint32_t>(loop.loopType);
+        loops.push_back(l);
+    }
+    w.section(LOOPS, loops);
+
+    std::vector<BakedRange> animations;
+    std::vector<int32_t> animationData;
+    for (const auto & animationLoop : animation.animations) {
+        animations.push_back(BakedRange{static_cast<uint32_t>(animationData.size()), static_cast<uint32_t>(animationLoop.size())});
+        animationData.insert(animationData.end(), animationLoop.begin(), animationLoop.end());
+    }
+    w.section(ANIMATIONS, animations);
+    w.section(ANIMATION_DATA, animationData);
+
+    std::vector<BakedSlice> slices;
+    std::vector<Slice::Key> sliceKeys;
+    std::vector<uint32_t> sliceFrameKeys;
+    for (const auto & slice : animation.slices) {
+        BakedSlice s;
+        std::memset(&s, 0, sizeof(s));
+        s.name = w.string(slice.name);
+        s.keys = BakedRange{static_cast<uint32_t>(sliceKeys.size()), static_cast<uint32_t>(slice.sliceKeys.size())};
+        s.frameKeys = BakedRange{static_cast<uint32_t>(sliceFrameKeys.size()), static_cast<uint32_t>(slice.frameKeys.size())};
+        sliceKeys.insert(sliceKeys.end(), slice.sliceKeys.begin(), slice.sliceKeys.end());
+        sliceFrameKeys.insert(sliceFrameKeys.end(), slice.frameKeys.begin(), slice.frameKeys.end());
+        slices.push_back(s);
+    }
+    w.section(SLICES, slices);
+    w.section(SLICE_KEYS, sliceKeys);
+    w.section(SLICE_FRAME_KEYS, sliceFrameKeys);
+
+    w.section(ANIMATION_LOOKUP, w.lookup(animation.animationLookup, animation.names));
+    w.section(SLICE_LOOKUP, w.lookup(animation.sliceLookup, animation.names));
+    w.section(LAYER_LOOKUP, w.lookup(animation.layerLookup, animation.names));
+
+    w.section(STRINGS, std::vector<char>(w.strings.begin(), w.strings.end()));
+
+    // pixel data goes last, image and mask tables are filled in once its offsets are known
+    std::vector<BakedImage> images(animation.images.size());
+    std::vector<BakedMask> masks(animation.masks.size());
+    w.section(IMAGES, images);
+    w.section(MASKS, masks);
+    for (size_t i = 0; i < images.size(); i++) {
+        const Image image = animation.decodedImage(i);
+        std::memset(&images[i], 0, sizeof(BakedImage));
+        images[i].width = image.width;
+        images[i].height = image.height;
+        images[i].pixels = w.append(image.pixels.data(), image.pixels.size(), PIXEL_ALIGNMENT);
+    }
+    for (size_t i = 0; i < masks.size(); i++) {
+        const auto & mask = animation.masks[i];
+        std::memset(&masks[i], 0, sizeof(BakedMask));
+        masks[i].width = mask.width;
+        masks[i].height = mask.height;
+        masks[i].wordsPerRow = mask.wordsPerRow;
+        masks[i].bits = w.append(mask.bits.data(), mask.bits.size(), PIXEL_ALIGNMENT);
+    }
+    const Section * sections = reinterpret_cast<const BakedHeader *>(w.data.data())->sections;
+    if (!images.empty()) {
+        std::memcpy(w.data.data() + sections[IMAGES].offset, images.data(), images.size() * sizeof(BakedImage));
+    }
+    if (!masks.empty()) {
+        std::memcpy(w.data.data() + sections[MASKS].offset, masks.data(), masks.size() * sizeof(BakedMask));
+    }
+
+    uint64_t fileSize = w.data.size();
+    std::memcpy(w.data.data() + offsetof(BakedHeader, fileSize), &fileSize, sizeof(fileSize));
+
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(w.data.data()), w.data.size());
+    return file.good();
+}
+
+BakedAnimation::BakedAnimation(BakedAnimation && baked) {
+    *this = std::move(baked);
+}
+
+BakedAnimation & BakedAnimation::operator =(BakedAnimation && baked) {
+    if (this != &baked) {
+        close();
+        buffer = std::move(baked.buffer);
+        data = baked.mapped ? baked.data : buffer.data();
+        size = baked.size;
+        mapped = baked.mapped;
+        baked.data = nullptr;
+        baked.size = 0;
+        baked.mapped = false;
+    }
+    return *this;
+}
+
+BakedAnimation::~BakedAnimation() {
+    close();
+}
+
+void BakedAnimation::close() {
+#ifdef ANIMATION_BAKED_MMAP
+    if (mapped && data) {
+        munmap(const_cast<uint8_t *>(data), size);
+    }
+#endif
+    buffer.clear();
+    data = nullptr;
+    size = 0;
+    mapped = false;
+}
+
+bool BakedAnimation::open(const std::string & path) {
+    close();
+#ifdef ANIMATION_BAKED_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(BakedHeader))) {
+        ::close(fd);
+        return false;
+    }
+    void * map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    data = static_cast<const uint8_t *>(map);
+    size = st.st_size;
+    mapped = true;
+#else
+    std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.good()) {
+        return false;
+    }
+    buffer.resize(file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+    if (!file.good() || buffer.size() < sizeof(BakedHeader)) {
+        buffer.clear();
+        return false;
+    }
+    data = buffer.data();
+    size = buffer.size();
+#endif
+    if (!validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool BakedAnimation::validate() const {
+    const BakedHeader & h = header();
+    if (h.magic != MAGIC || h.version != VERSION || h.endianTag != ENDIAN_TAG || h.fileSize != size) {
+        return false;
+    }
+    for (const auto & section : h.sections) {
+        if (section.offset > size || section.size > size - section.offset || section.offset % SECTION_ALIGNMENT) {
+            return false;
+        }
+    }
+    if (h.sections[PALETTE].size < sizeof(Palette) || h.sections[PALETTE].size % sizeof(Palette)
+        || frames().size != h.framesCount) {
+        return false;
+    }
+    const auto framePalettes = section<uint16_t>(FRAME_PALETTES);
+    if (framePalettes.size != 0 && framePalettes.size != h.framesCount) {
+        return false;
+    }
+    for (uint16_t index : framePalettes) {
+        // 0 is the palette of the first frame, toAnimation() keeps the others
+        if (index == 0 || index >= section<Palette>(PALETTE).size) return false;
+    }
+    const auto cels = section<Cel>(CELS);
+    for (const auto & layer : layers()) {
+        if (!layer.isGroupLayer && (layer.firstCel > cels.size || cels.size - layer.firstCel < h.framesCount)) {
+            return false;
+        }
+    }
+    const size_t images = section<BakedImage>(IMAGES).size;
+    for (const auto & cel : cels) {
+        if (cel.image != Cel::NO_IMAGE && cel.image >= images) return false;
+    }
+    const size_t masks = section<BakedMask>(MASKS).size;
+    if (masks != 0 && masks != images) {
+        return false;
+    }
+    const size_t strings = h.sections[STRINGS].size;
+    auto validString = [strings](const BakedString & s) {
+        return s.offset <= strings && s.length <= strings - s.offset;
+    };
+    for (const auto & layer : layers()) {
+        if (!validString(layer.name)) return false;
+    }
+    for (const auto & loop : loops()) {
+        if (!validString(loop.name) || loop.from > loop.to || loop.to >= h.framesCount) return false;
+    }
+    const auto frameKeys = section<uint32_t>(SLICE_FRAME_KEYS);
+    for (const auto & slice : slices()) {
+        if (!validString(slice.name)
+            || slice.keys.first + uint64_t(slice.keys.count) > section<Slice::Key>(SLICE_KEYS).size
+            || slice.frameKeys.first + uint64_t(slice.frameKeys.count) > frameKeys.size) {
+            return false;
+        }
+        for (uint32_t f = 0; f < slice.frameKeys.count; f++) {
+            const uint32_t key = frameKeys[slice.frameKeys.first + f];
+            if (key != Slice::NO_KEY && key >= slice.keys.count) return false;
+        }
+    }
+    const std::pair<SECTION, size_t> lookups[] = {
+        {ANIMATION_LOOKUP, section<BakedRange>(ANIMATIONS).size},
+        {SLICE_LOOKUP, slices().size},
+        {LAYER_LOOKUP, layers().size}
+    };
+    for (const auto & [lookup, targets] : lookups) {
+        for (const auto & l : section<BakedLookup>(lookup)) {
+            if (!validString(l.name) || l.index >= targets) return false;
+        }
+    }
+    const auto animationData = section<int32_t>(ANIMATION_DATA);
+    for (const auto & range : section<BakedRange>(ANIMATIONS)) {
+        if (range.first + uint64_t(range.count) > animationData.size) return false;
+        // frame, duration pairs up to a -1 frame
+        const int32_t * loop = animationData.data + range.first;
+        for (uint32_t i = 0; i + 1 < range.count && loop[i] != -1; i += 2) {
+            if (loop[i] < 0 || loop[i] >= h.framesCount || loop[i + 1] < 0) return false;
+        }
+    }
+    for (const auto & image : section<BakedImage>(IMAGES)) {
+        uint64_t bytes = uint64_t(image.width) * image.height;
+        if (image.pixels > size || bytes > size - image.pixels) return false;
+    }
+    for (const auto & mask : section<BakedMask>(MASKS)) {
+        uint64_t bytes = uint64_t(mask.wordsPerRow) * mask.height * sizeof(uint64_t);
+        if (mask.bits > size || bytes > size - mask.bits || mask.bits % alignof(uint64_t)) return false;
+    }
+    return true;
+}
+
+int32_t BakedAnimation::find(SECTION lookup, std::string_view name) const {
+    const auto entries = section<BakedLookup>(lookup);
+    const uint64_t h = hash(name);
+    auto it = std::lower_bound(entries.begin(), entries.end(), h,
+        [](const BakedLookup & l, uint64_t h) { return l.hash < h; });
+    for (; it != entries.end() && it->hash == h; ++it) {
+        if (string(it->name) == name) {
+            return it->index;
+        }
+    }
+    return -1;
+}
+
+const Slice::Key * BakedAnimation::getSliceKey(size_t slice, uint32_t frame) const {
+    const auto & s = slices()[slice];
+    const auto keys = sliceKeys(slice);
+    if (frame < s.frameKeys.count) {
+        uint32_t key = section<uint32_t>(SLICE_FRAME_KEYS)[s.frameKeys.first + frame];
+        return key < keys.size ? &keys[key] : nullptr;
+    }
+    auto it = std::upper_bound(keys.begin(), keys.end(), frame,
+        [](uint32_t frame, const Slice::Key & key) { return frame < key.frame; });
+    return it == keys.begin() ? nullptr : it - 1;
+}
+
+Animation BakedAnimation::toAnimation() const {
+    Animation animation;
+    animation.width = width();
+    animation.height = height();
+    animation.framesCount = framesCount();
+    animation.transparentIndex = transparentIndex();
+    animation.premultiplied = premultiplied();
+    animation.palette = palette();
+    const auto palettes = section<Palette>(PALETTE);
+    animation.palettes.assign(palettes.begin() + 1, palettes.end());
+    for (uint16_t index : section<uint16_t>(FRAME_PALETTES)) {
+        animation.framePalettes.push_back(index - 1);
+    }
+    animation.frames.assign(frames().begin(), frames().end());
+    for (const auto & l : layers()) {
+        auto & layer = animation.layers.emplace_back(
+            Layer::BLEND_MODE(l.blendMode),
+            l.visible,
+            l.isGroupLayer,
+            l.opacity,
+            std::string(string(l.name)),
+            animation.framesCount);
+        layer.childLevel = l.childLevel;
+        for (uint16_t f = 0; f < layer.frames.size(); f++) {
+            layer.frames[f] = section<Cel>(CELS)[l.firstCel + f];
+        }
+    }
+    animation.images.reserve(imagesCount());
+    for (size_t i = 0; i < imagesCount(); i++) {
+        ImageView image = this->image(i);
+        animation.images.emplace_back(image.width, image.height,
+            std::vector<uint8_t>(image.pixels, image.pixels + size_t(image.width) * image.height));
+    }
+    if (hasMasks()) {
+        animation.masks.reserve(imagesCount());
+        for (size_t i = 0; i < section<BakedMask>(MASKS).size; i++) {
+            MaskView view = mask(i);
+            CollisionMask & m = animation.masks.emplace_back(view.width, view.height);
+            std::copy(view.bits, view.bits + m.bits.size(), m.bits.begin());
+        }
+    }
+    for (const auto & l : loops()) {
+        animation.loops.emplace_back(l.from, l.to, LoopType(l.loopType), std::string(string(l.name)));
+    }
+    for (size_t i = 0; i < animationsCount(); i++) {
+        auto loop = this->animation(i);
+        animation.animations.emplace_back(loop.begin(), loop.end());
+    }
+    for (size_t i = 0; i < slices().size; i++) {
+        const auto & s = slices()[i];
+        auto keys = sliceKeys(i);
+        auto frameKeys = section<uint32_t>(SLICE_FRAME_KEYS);
+        animation.slices.emplace_back(Slice{
+            .name = std::string(string(s.name)),
+            .sliceKeys = std::vector<Slice::Key>(keys.begin(), keys.end()),
+            .frameKeys = std::vector<uint32_t>(frameKeys.data + s.frameKeys.first, frameKeys.data + s.frameKeys.first + s.frameKeys.count)
+        });
+    }
+    auto restore = [&](SECTION lookup, FlatHashMap<NameHandle, size_t> & map) {
+        for (const auto & l : section<BakedLookup>(lookup)) {
+            map[animation.names.intern(string(l.name))] = l.index;
+        }
+    };
+    restore(ANIMATION_LOOKUP, animation.animationLookup);
+    restore(SLICE_LOOKUP, animation.sliceLookup);
+    restore(LAYER_LOOKUP, animation.layerLookup);
+    animation.buildLayerTree();
+    animation.buildFrameCels();
+    return animation;
+}
+
+}
@@ -0,0 +1,336 @@
+/*
+ * Baked animation - binary format of a converted Animation
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef ANIMATION_BAKED_H
+#define ANIMATION_BAKED_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "animation.h"
+
+namespace animation {
+
+/**
+ * Layout of the file, all values are native endian, every section is 64 byte aligned,
+ * image pixels 16 byte aligned. Offsets are from the start of the file.
+ *
+ * BakedHeader
+ * sections, as listed in BakedHeader::sections
+ * string data (names referenced by offset and length)
+ * pixel data of images and masks
+ */
+namespace baked {
+
+constexpr uint32_t MAGIC = 0x42455341; // "ASEB"
+constexpr uint32_t VERSION = 4; // 2: empty cels have Cel::NO_IMAGE, 3: BakedLayer::childLevel, 4: FRAME_PALETTES
+constexpr uint32_t ENDIAN_TAG = 0x01020304;
+constexpr uint8_t FLAG_PREMULTIPLIED = 0x1;
+
+enum SECTION {
+    PALETTE,      // Palette[], the palette of the first frame and the others of Animation::palettes
+    FRAMES,       // Frame[framesCount]
+    FRAME_PALETTES, // uint16_t[], empty or framesCount indices to PALETTE
+    LAYERS,       // BakedLayer[]
+    CELS,         // Cel[], framesCount cels for every non group layer
+    IMAGES,       // BakedImage[]
+    MASKS,        // BakedMask[], empty or parallel to images
+    LOOPS,        // BakedLoop[]
+    ANIMATIONS,   // BakedRange[] into ANIMATION_DATA
+    ANIMATION_DATA, // int32_t[]
+    SLICES,       // BakedSlice[]
+    SLICE_KEYS,   // Slice::Key[]
+    SLICE_FRAME_KEYS, // uint32_t[]
+    ANIMATION_LOOKUP, // BakedLookup[] sorted by hash
+    SLICE_LOOKUP,     // BakedLookup[] sorted by hash
+    LAYER_LOOKUP,     // BakedLookup[] sorted by hash
+    STRINGS,      // char[]
+    SECTION_COUNT
+};
+
+struct Section {
+    uint64_t offset;
+    uint64_t size; // bytes
+};
+
+struct BakedHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t reserved;
+    uint64_t fileSize;
+    uint16_t width;
+    uint16_t height;
+    uint16_t framesCount;
+    uint8_t transparentIndex;
+    uint8_t flags; // FLAG_PREMULTIPLIED
+    Section sections[SECTION_COUNT];
+};
+
+struct BakedString {
+    uint32_t offset; // into STRINGS
+    uint32_t length;
+};
+
+struct BakedLayer {
+    BakedString name;
+    uint32_t firstCel; // index to CELS, UINT32_MAX for group layers
+    uint8_t blendMode;
+    uint8_t visible;
+    uint8_t isGroupLayer;
+    uint8_t opacity;
+    uint16_t childLevel;
+    uint16_t unused;
+};
+
+struct BakedImage {
+    uint16_t width;
+    uint16_t height;
+    uint32_t unused;
+    uint64_t pixels; // offset of width * height indexed pixels
+};
+
+struct BakedMask {
+    uint16_t width;
+    uint16_t height;
+    uint32_t wordsPerRow;
+    uint64_t bits; // offset of wordsPerRow * height words
+};
+
+struct BakedLoop {
+    BakedString name;
+    uint16_t from;
+    uint16_t to;
+    uint32_t loopType;
+};
+
+struct BakedRange {
+    uint32_t first;
+    uint32_t count;
+};
+
+struct BakedSlice {
+    BakedString name;
+    BakedRange keys; // into SLICE_KEYS
+    BakedRange frameKeys; // into SLICE_FRAME_KEYS
+};
+
+struct BakedLookup {
+    uint64_t hash; // fnv1a of the name
+    BakedString name;
+    uint32_t index;
+    uint32_t unused;
+};
+
+uint64_t hash(std::string_view name);
+
+}
+
+/**
+ * Writes the animation in the baked format, returns false on I/O error.
+ */
+bool writeBaked(const Animation & animation, const std::string & path);
+
+/**
+ * Read only view of a baked animation file mapped into memory.
+ * Nothing is copied, all returned pointers point into the mapping
+ * and stay valid while the BakedAnimation lives.
+ */
+class BakedAnimation {
+public:
+    struct ImageView {
+        uint16_t width;
+        uint16_t height;
+        const uint8_t * pixels;
+    };
+
+    struct MaskView {
+        uint16_t width;
+        uint16_t height;
+        uint32_t wordsPerRow;
+        const uint64_t * bits;
+    };
+
+    template <typename T>
+    struct ArrayView {
+        const T * data;
+        size_t size;
+
+        const T * begin() const {
+            return data;
+        }
+
+        const T * end() const {
+            return data + size;
+        }
+
+        const T & operator [](size_t i) const {
+            return data[i];
+        }
+    };
+
+private:
+    const uint8_t * data = nullptr;
+    size_t size = 0;
+    std::vector<uint8_t> buffer; // used when the file can't be mapped
+    bool mapped = false;
+
+    const baked::BakedHeader & header() const {
+        return *reinterpret_cast<const baked::BakedHeader *>(data);
+    }
+
+    template <typename T>
+    ArrayView<T> section(baked::SECTION s) const {
+        const baked::Section & section = header().sections[s];
+        return ArrayView<T>{reinterpret_cast<const T *>(data + section.offset), section.size / sizeof(T)};
+    }
+
+    bool validate() const;
+    int32_t find(baked::SECTION lookup, std::string_view name) const;
+    void close();
+
+public:
+    BakedAnimation() = default;
+    BakedAnimation(const BakedAnimation &) = delete;
+    BakedAnimation & operator =(const BakedAnimation &) = delete;
+    BakedAnimation(BakedAnimation && baked);
+    BakedAnimation & operator =(BakedAnimation && baked);
+    ~BakedAnimation();
+
+    /**
+     * Maps the file, returns false if it can't be read or isn't a valid baked animation.
+     */
+    bool open(const std::string & path);
+
+    bool isOpen() const {
+        return data != nullptr;
+    }
+
+    uint16_t width() const {
+        return header().width;
+    }
+
+    uint16_t height() const {
+        return header().height;
+    }
+
+    uint16_t framesCount() const {
+        return header().framesCount;
+    }
+
+    uint8_t transparentIndex() const {
+        return header().transparentIndex;
+    }
+
+    /**
+     * Colors of the palettes are multiplied by alpha.
+     */
+    bool premultiplied() const {
+        return header().flags & baked::FLAG_PREMULTIPLIED;
+    }
+
+    const Palette & palette() const {
+        return *reinterpret_cast<const Palette *>(data + header().sections[baked::PALETTE].offset);
+    }
+
+    const Palette & framePalette(uint32_t frame) const {
+        const auto framePalettes = section<uint16_t>(baked::FRAME_PALETTES);
+        return frame < framePalettes.size ? section<Palette>(baked::PALETTE)[framePalettes[frame]] : palette();
+    }
+
+    ArrayView<Frame> frames() const {
+        return section<Frame>(baked::FRAMES);
+    }
+
+    ArrayView<baked::BakedLayer> layers() const {
+        return section<baked::BakedLayer>(baked::LAYERS);
+    }
+
+    /**
+     * Cel of a non group layer.
+     */
+    const Cel & cel(size_t layer, uint16_t frame) const {
+        return section<Cel>(baked::CELS)[layers()[layer].firstCel + frame];
+    }
+
+    size_t imagesCount() const {
+        return section<baked::BakedImage>(baked::IMAGES).size;
+    }
+
+    ImageView image(size_t i) const {
+        const auto & image = section<baked::BakedImage>(baked::IMAGES)[i];
+        return ImageView{image.width, image.height, data + image.pixels};
+    }
+
+    bool hasMasks() const {
+        return section<baked::BakedMask>(baked::MASKS).size > 0;
+    }
+
+    MaskView mask(size_t i) const {
+        const auto & mask = section<baked::BakedMask>(baked::MASKS)[i];
+        return MaskView{mask.width, mask.height, mask.wordsPerRow, reinterpret_cast<const uint64_t *>(data + mask.bits)};
+    }
+
+    ArrayView<baked::BakedLoop> loops() const {
+        return section<baked::BakedLoop>(baked::LOOPS);
+    }
+
+    size_t animationsCount() const {
+        return section<baked::BakedRange>(baked::ANIMATIONS).size;
+    }
+
+    /**
+     * Loop in the format of Animation::animations - frame,duration,...,-1,0
+     */
+    ArrayView<int32_t> animation(size_t i) const {
+        const auto & range = section<baked::BakedRange>(baked::ANIMATIONS)[i];
+        return ArrayView<int32_t>{section<int32_t>(baked::ANIMATION_DATA).data + range.first, range.count};
+    }
+
+    ArrayView<baked::BakedSlice> slices() const {
+        return section<baked::BakedSlice>(baked::SLICES);
+    }
+
+    ArrayView<Slice::Key> sliceKeys(size_t slice) const {
+        const auto & range = slices()[slice].keys;
+        return ArrayView<Slice::Key>{section<Slice::Key>(baked::SLICE_KEYS).data + range.first, range.count};
+    }
+
+    /**
+     * Key of the slice in effect for given frame, nullptr if there is none.
+     */
+    const Slice::Key * getSliceKey(size_t slice, uint32_t frame) const;
+
+    std::string_view string(const baked::BakedString & s) const {
+        return std::string_view(reinterpret_cast<const char *>(data + header().sections[baked::STRINGS].offset + s.offset), s.length);
+    }
+
+    // index or -1
+    int32_t findAnimation(std::string_view name) const {
+        return find(baked::ANIMATION_LOOKUP, name);
+    }
+
+    int32_t findSlice(std::string_view name) const {
+        return find(baked::SLICE_LOOKUP, name);
+    }
+
+    int32_t findLayer(std::string_view name) const {
+        return find(baked::LAYER_LOOKUP, name);
+    }
+
+    /**
+     * Copies the data into a regular Animation.
+     */
+    Animation toAnimation() const;
+};
+
+}
+#endif
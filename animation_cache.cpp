@@ -0,0 +1,136 @@
+/*
+ * Cache of loaded sprites
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#include <exception>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "animation_cache.h"
+#include "aseprite.h"
+#include "aseprite_to_animation.h"
+#include "load_stats.h"
+
+namespace animation {
+
+size_t AnimationCache::footprint(const Animation & animation) {
+    return animation.memoryFootprint();
+}
+
+size_t AnimationCache::KeyHash::operator ()(const Key & key) const {
+    size_t options = key.collisionMasks | key.maskAlphaThreshold << 1 | key.celChecksums << 9
+        | key.premultipliedAlpha << 10 | key.rleImages << 11 | key.rleOnly << 12;
+    return std::hash<std::string>()(key.path) ^ options * 0x9E3779B97F4A7C15ull;
+}
+
+// reads the file like Animation::loadAseImage, but tells a missing or broken file apart
+static AnimationCache::Handle loadShared(const std::string & path, const LoadOptions & options) {
+    aseprite::ASEPRITE ase = makeReader(options);
+    if (!ase.read(path)) {
+        return nullptr;
+    }
+    aseprite::LoadStats::Scope scope(options.stats, aseprite::LoadStats::CONVERT);
+    return std::make_shared<const Animation>(fromASEPRITE(ase, options));
+}
+
+AnimationCache::Handle AnimationCache::get(const std::string & path, const LoadOptions & options) {
+    Key key{path, options.collisionMasks, options.collisionMasks ? options.maskAlphaThreshold : uint8_t(0),
+            options.celChecksums, options.premultipliedAlpha, options.rleImages,
+            options.rleImages && options.rleOnly};
+    std::promise<Handle> promise;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto found = entries.find(key);
+        if (found != entries.end()) {
+            counters.hits++;
+            Entry & entry = found->second;
+            if (entry.animation) {
+                recent.splice(recent.begin(), recent, entry.lru);
+                return entry.animation;
+            }
+            auto pending = entry.pending;
+            lock.unlock();
+            return pending.get();
+        }
+        counters.misses++;
+        entries[key].pending = promise.get_future().share();
+    }
+
+    // loaded without the lock, other threads asking for this key wait on the future
+    Handle animation;
+    try {
+        animation = loadShared(path, options);
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            entries.erase(key);
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (animation) {
+            Entry & entry = entries[key];
+            entry.pending = std::shared_future<Handle>();
+            entry.animation = animation;
+            entry.bytes = footprint(*animation);
+            entry.lru = recent.insert(recent.begin(), key);
+            counters.bytes += entry.bytes;
+            evict(budget);
+        } else {
+            entries.erase(key);
+        }
+    }
+    promise.set_value(animation);
+    return animation;
+}
+
+void AnimationCache::evict(size_t limit) {
+    auto it = recent.end();
+    while (counters.bytes > limit && it != recent.begin()) {
+        --it;
+        auto found = entries.find(*it);
+        if (found->second.animation.use_count() > 1) {
+            continue; // somebody holds a handle
+        }
+        counters.bytes -= found->second.bytes;
+        counters.evictions++;
+        entries.erase(found);
+        it = recent.erase(it);
+    }
+}
+
+void AnimationCache::trim() {
+    std::lock_guard<std::mutex> lock(mutex);
+    evict(budget);
+}
+
+void AnimationCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    evict(0);
+}
+
+void AnimationCache::setBudget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = bytes;
+    evict(budget);
+}
+
+AnimationCache::Metrics AnimationCache::metrics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Metrics result = counters;
+    result.entries = entries.size();
+    return result;
+}
+
+AnimationCache & sharedAnimationCache() {
+    static AnimationCache cache;
+    return cache;
+}
+
+}
@@ -0,0 +1,125 @@
+/*
+ * Cache of loaded sprites
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef ANIMATION_CACHE_H
+#define ANIMATION_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "animation.h"
+
+namespace animation {
+
+/**
+ * Shares loaded animations: every get() of the same path and options returns the same
+ * immutable Animation. Threads asking for a file being loaded wait for that load instead
+ * of starting another one.
+ *
+ * Animations nobody holds a handle to are kept until the cached bytes exceed the budget,
+ * then the least recently used ones are dropped. Animations still in use are never dropped,
+ * the cache can exceed the budget while they are.
+ */
+class AnimationCache {
+public:
+    using Handle = std::shared_ptr<const Animation>;
+
+    struct Metrics {
+        uint64_t hits = 0; // including waits for a load already running
+        uint64_t misses = 0; // loads started
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0; // estimate of the memory held by cached animations
+    };
+
+    explicit AnimationCache(size_t budget = DEFAULT_BUDGET) :
+        budget(budget) {
+    }
+
+    AnimationCache(const AnimationCache &) = delete;
+    AnimationCache & operator =(const AnimationCache &) = delete;
+
+    /**
+     * Loads the file or returns the cached animation, nullptr if the file can't be read
+     * (failures aren't cached). Only the options changing the animation are part of the key,
+     * stats, memory and context are used by the load that runs.
+     */
+    Handle get(const std::string & path, const LoadOptions & options = LoadOptions());
+
+    /**
+     * Drops unused animations until the cache fits the budget, get() does it after every load.
+     * Call it after releasing handles to free their memory early.
+     */
+    void trim();
+
+    /**
+     * Drops all unused animations, loads running are kept.
+     */
+    void clear();
+
+    void setBudget(size_t bytes);
+
+    Metrics metrics() const;
+
+    /**
+     * Estimate of the memory used by the animation, see Animation::memoryFootprint.
+     */
+    static size_t footprint(const Animation & animation);
+
+    static constexpr size_t DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+private:
+    struct Key {
+        std::string path;
+        bool collisionMasks;
+        uint8_t maskAlphaThreshold;
+        bool celChecksums;
+        bool premultipliedAlpha;
+        bool rleImages;
+        bool rleOnly;
+
+        bool operator ==(const Key & other) const {
+            return path == other.path && collisionMasks == other.collisionMasks
+                && maskAlphaThreshold == other.maskAlphaThreshold && celChecksums == other.celChecksums
+                && premultipliedAlpha == other.premultipliedAlpha && rleImages == other.rleImages
+                && rleOnly == other.rleOnly;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator ()(const Key & key) const;
+    };
+
+    struct Entry {
+        std::shared_future<Handle> pending; // valid while loading
+        Handle animation;
+        size_t bytes = 0;
+        std::list<Key>::iterator lru; // into recent, loaded entries only
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::list<Key> recent; // most recently used first
+    size_t budget;
+    Metrics counters;
+
+    void evict(size_t limit); // with the mutex locked
+};
+
+/**
+ * Cache shared by the whole process.
+ */
+AnimationCache & sharedAnimationCache();
+
+}
+
+#endif
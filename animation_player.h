@@ -0,0 +1,259 @@
+/*
+ * Batch animation player
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef ANIMATION_PLAYER_H
+#define ANIMATION_PLAYER_H
+
+#include <cstdint>
+#include <cassert>
+#include <cstddef>
+
+#include <string>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include "animation.h"
+
+namespace animation {
+
+/**
+ * Plays many instances of loops of one shared Animation.
+ *
+ * Instance state is kept as structure of arrays and the loops from
+ * Animation::animations are flattened into lookup tables quantized by the
+ * greatest common divisor of their frame durations, so update() is a
+ * branch-free pass over all instances.
+ */
+class AnimationPlayerPool {
+public:
+    static constexpr uint32_t NO_IMAGE = Cel::NO_IMAGE;
+
+    const Animation & animation;
+
+private:
+    // loop data, indexed by loop (index to animation.animations)
+    std::vector<uint32_t> loopOffset; // first step in stepFrames
+    std::vector<uint32_t> loopLastStep; // number of steps - 1
+    std::vector<float> loopDuration; // ms
+    std::vector<float> loopInvDuration;
+    std::vector<float> loopInvQuantum; // 1 / gcd of durations in the loop
+    std::vector<uint16_t> stepFrames; // frame for each quantum of each loop
+
+    std::vector<uint32_t> imageTable; // layer * framesCount + frame -> image
+
+    // instance data
+    std::vector<uint32_t> loops;
+    std::vector<uint32_t> layers;
+    std::vector<float> times; // ms since start of the loop
+    std::vector<uint16_t> frames;
+    std::vector<uint32_t> images;
+
+public:
+    AnimationPlayerPool(const Animation & animation) :
+        animation(animation) {
+        const size_t loopCount = animation.animations.size();
+        loopOffset.reserve(loopCount);
+        loopLastStep.reserve(loopCount);
+        loopDuration.reserve(loopCount);
+        loopInvDuration.reserve(loopCount);
+        loopInvQuantum.reserve(loopCount);
+
+        for (const auto & animationLoop : animation.animations) {
+            uint32_t quantum = 0;
+            uint32_t total = 0;
+            for (size_t i = 0; i + 1 < animationLoop.size() && animationLoop[i] != -1; i += 2) {
+                quantum = std::gcd(quantum, static_cast<uint32_t>(animationLoop[i + 1]));
+                total += animationLoop[i + 1];
+            }
+
+            loopOffset.push_back(stepFrames.size());
+            if (total == 0) { // nothing to play, stay on the first frame
+                stepFrames.push_back(animationLoop.size() > 1 && animationLoop[0] != -1 ? animationLoop[0] : 0);
+                loopLastStep.push_back(0);
+                loopDuration.push_back(1.0f);
+                loopInvDuration.push_back(1.0f);
+                loopInvQuantum.push_back(0.0f);
+                continue;
+            }
+            for (size_t i = 0; i + 1 < animationLoop.size() && animationLoop[i] != -1; i += 2) {
+                stepFrames.insert(stepFrames.end(), animationLoop[i + 1] / quantum, animationLoop[i]);
+            }
+            loopLastStep.push_back(total / quantum - 1);
+            loopDuration.push_back(total);
+            loopInvDuration.push_back(1.0f / total);
+            loopInvQuantum.push_back(1.0f / quantum);
+        }
+
+        imageTable.resize(animation.layers.size() * animation.framesCount, NO_IMAGE);
+        for (size_t l = 0; l < animation.layers.size(); l++) {
+            const auto & cels = animation.layers[l].frames;
+            for (size_t f = 0; f < cels.size() && f < animation.framesCount; f++) {
+                imageTable[l * animation.framesCount + f] = cels[f].image;
+            }
+        }
+    }
+
+    size_t size() const {
+        return times.size();
+    }
+
+    void reserve(size_t count) {
+        loops.reserve(count);
+        layers.reserve(count);
+        times.reserve(count);
+        frames.reserve(count);
+        images.reserve(count);
+    }
+
+    /**
+     * Adds an instance playing given loop, returns its index.
+     * Image indices are reported for the given layer, negative start times start at 0.
+     */
+    uint32_t add(size_t loop, uint32_t layer = 0, float startTime = 0.0f) {
+        assert(loop < loopOffset.size());
+        assert(layer < animation.layers.size());
+        loops.push_back(loop);
+        layers.push_back(layer);
+        times.push_back(clampTime(startTime));
+        frames.push_back(0);
+        images.push_back(NO_IMAGE);
+        uint32_t instance = times.size() - 1;
+        update(instance, 0.0f);
+        return instance;
+    }
+
+    uint32_t add(const std::string & loopName, uint32_t layer = 0, float startTime = 0.0f) {
+        return add(loopIndex(animation.getName(loopName)), layer, startTime);
+    }
+
+    /**
+     * Removes an instance, the last instance is moved to its index.
+     */
+    void remove(uint32_t instance) {
+        assert(instance < size());
+        loops[instance] = loops.back();
+        layers[instance] = layers.back();
+        times[instance] = times.back();
+        frames[instance] = frames.back();
+        images[instance] = images.back();
+        loops.pop_back();
+        layers.pop_back();
+        times.pop_back();
+        frames.pop_back();
+        images.pop_back();
+    }
+
+    void clear() {
+        loops.clear();
+        layers.clear();
+        times.clear();
+        frames.clear();
+        images.clear();
+    }
+
+    /**
+     * Restarts the instance with another loop, negative start times start at 0.
+     */
+    void play(uint32_t instance, size_t loop, float startTime = 0.0f) {
+        assert(loop < loopOffset.size());
+        loops[instance] = loop;
+        times[instance] = clampTime(startTime);
+        update(instance, 0.0f);
+    }
+
+    void play(uint32_t instance, const std::string & loopName, float startTime = 0.0f) {
+        play(instance, loopIndex(animation.getName(loopName)), startTime);
+    }
+
+    void setLayer(uint32_t instance, uint32_t layer) {
+        assert(layer < animation.layers.size());
+        layers[instance] = layer;
+        images[instance] = imageTable[layer * animation.framesCount + frames[instance]];
+    }
+
+    /**
+     * Advances all instances by deltaTime milliseconds and refreshes their frame and image
+     * indices. Time doesn't run backwards, a negative deltaTime counts as 0.
+     */
+    void update(float deltaTime) {
+        deltaTime = clampTime(deltaTime);
+        const size_t count = times.size();
+        const uint32_t * loop = loops.data();
+        const uint32_t * layer = layers.data();
+        float * time = times.data();
+        uint16_t * frame = frames.data();
+        uint32_t * image = images.data();
+        const float * duration = loopDuration.data();
+        const float * invDuration = loopInvDuration.data();
+        const float * invQuantum = loopInvQuantum.data();
+        const uint32_t * offset = loopOffset.data();
+        const uint32_t * lastStep = loopLastStep.data();
+        const uint16_t * steps = stepFrames.data();
+        const uint32_t * imageOf = imageTable.data();
+        const uint32_t framesCount = animation.framesCount;
+
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t l = loop[i];
+            const float t = time[i] + deltaTime;
+            time[i] = t - duration[l] * static_cast<float>(static_cast<int32_t>(t * invDuration[l]));
+        }
+        for (size_t i = 0; i < count; i++) {
+            const uint32_t l = loop[i];
+            const uint32_t step = std::min(static_cast<uint32_t>(time[i] * invQuantum[l]), lastStep[l]);
+            frame[i] = steps[offset[l] + step];
+            image[i] = imageOf[layer[i] * framesCount + frame[i]];
+        }
+    }
+
+    const uint16_t * currentFrames() const {
+        return frames.data();
+    }
+
+    const uint32_t * currentImages() const {
+        return images.data();
+    }
+
+    /**
+     * Loop index for an interned loop name, resolve once and pass it to add() and play().
+     */
+    size_t loopIndex(NameHandle loopName) const {
+        const size_t * index = animation.animationLookup.find(loopName);
+        return index == nullptr ? 0 : *index;
+    }
+
+    uint16_t getFrame(uint32_t instance) const {
+        return frames[instance];
+    }
+
+    uint32_t getImage(uint32_t instance) const {
+        return images[instance];
+    }
+
+    float getTime(uint32_t instance) const {
+        return times[instance];
+    }
+
+private:
+    // frame steps are converted to unsigned, times or steps below 0 (or NaN) would be undefined there
+    static float clampTime(float time) {
+        return time > 0.0f ? time : 0.0f;
+    }
+
+    void update(uint32_t instance, float deltaTime) {
+        const uint32_t l = loops[instance];
+        float t = times[instance] + deltaTime;
+        t -= loopDuration[l] * static_cast<float>(static_cast<int32_t>(t * loopInvDuration[l]));
+        times[instance] = t;
+        const uint32_t step = std::min(static_cast<uint32_t>(t * loopInvQuantum[l]), loopLastStep[l]);
+        frames[instance] = stepFrames[loopOffset[l] + step];
+        images[instance] = imageTable[layers[instance] * animation.framesCount + frames[instance]];
+    }
+};
+
+}
+#endif
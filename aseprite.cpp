@@ -17,8 +17,13 @@
 #include <fstream>
 #include <array>
 #include <memory>
+#include <memory_resource>
 #include <variant>
-#include "tinf/tinf.h"
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include "decompressor.h"
+#include "decoder_context.h"
 #include "aseprite.h"
 
 namespace aseprite {
@@ -31,6 +36,36 @@ bool operator &(std::ifstream & s, aseprite::ASE_HEADER & header) {
     return header.read(s);
 }
 
+bool operator |(std::ostream & s, const STRING & string) {
+    return string.write(s);
+}
+
+bool operator |(std::ostream & s, const aseprite::ASE_HEADER & header) {
+    return header.write(s);
+}
+
+// writes the DWORD size of everything written since start at start, sizes of files, frames and chunks include the size itself
+static bool writeSize(std::ostream & s, std::streampos start) {
+    auto end = s.tellp();
+    DWORD size = end - start;
+    s.seekp(start);
+    bool result = s | size;
+    s.seekp(end);
+    return result && s.good();
+}
+
+STRING::STRING(std::pmr::memory_resource * memory) :
+    length(0),
+    data(memory) {
+
+}
+
+STRING::STRING(const std::string & string, std::pmr::memory_resource * memory) :
+    length(string.size()),
+    data(string.begin(), string.end(), memory) {
+
+}
+
 STRING::STRING(STRING && s) :
     length(s.length),
     data(std::move(s.data)) {
@@ -54,6 +89,13 @@ bool STRING::read(std::ifstream & s) {
     return result;
 }
 
+bool STRING::write(std::ostream & s) const {
+    WORD size = data.size();
+    bool result = s | size;
+    s.write((const char *) data.data(), size);
+    return result && s.good();
+}
+
 std::string STRING::toString() const {
     return std::string(reinterpret_cast<const char *>(&data[0]), data.size());
 }
@@ -77,6 +119,29 @@ bool ASE_HEADER::read(std::ifstream & s) { //order must match order of member va
         && s & reserved;
 }
 
+bool ASE_HEADER::write(std::ostream & s) const {
+    return s | fileSize
+        && s | magicNumber
+        && s | frames
+        && s | width
+        && s | height
+        && s | bitDepth
+        && s | flags
+        && s | speed
+        && s | stuff_0
+        && s | stuff_1
+        && s | transparentIndex
+        && s | stuff_2
+        && s | colorsCount
+        && s | pixelWidth
+        && s | pixelHeight
+        && s | reserved;
+}
+
+PIXELTYPE ASE_HEADER::pixelFormat() const {
+    return bitDepth == 8 ? INDEXED : bitDepth == 16 ? GRAYSCALE : RGBA;
+}
+
 void ASE_HEADER::toString(){
     std::cout << "HEADER\n"
        "fileSize           :"      << fileSize                << "\n"
@@ -139,7 +204,25 @@ bool PALETTE_OLD_CHUNK::read(std::ifstream & s){
 	return result;
 }
 
+bool PALETTE_OLD_CHUNK::write(std::ostream & s) const {
+    WORD packets = 1;
+    BYTE skip = 0;
+    BYTE colorsCount = 0; // 256
+    bool result = s | packets
+        && s | skip
+        && s | colorsCount;
+    for (size_t c = 0; c < colors.size() && result; c++) {
+        result = s | colors[c].r
+            && s | colors[c].g
+            && s | colors[c].b;
+    }
+    return result;
+}
+
 PALETTE_CHUNK::PALETTE_CHUNK(PALETTE_CHUNK && palette) :
+    size(palette.size),
+    first(palette.first),
+    last(palette.last),
     colors(std::move(palette.colors)) {
 }
 
@@ -148,17 +231,17 @@ PALETTE_CHUNK::PALETTE_CHUNK(std::ifstream & s) {
 }
 
 PALETTE_CHUNK & PALETTE_CHUNK::operator =(const PALETTE_CHUNK && palette) {
+    size = palette.size;
+    first = palette.first;
+    last = palette.last;
     colors = std::move(palette.colors);
     return *this;
 }
 
 bool PALETTE_CHUNK::read(std::ifstream & s) {
-    DWORD newSize; // total number of entries
-    DWORD first;
-    DWORD last;
     BYTE unused[8];
 
-    bool result = s & newSize
+    bool result = s & size
         && s & first
         && s & last
         && s & unused;
@@ -171,7 +254,6 @@ bool PALETTE_CHUNK::read(std::ifstream & s) {
         }
         Color & c = colors[i];
         WORD flags;
-        STRING foobar;
         result = result
             && s & flags
             && s & c.r
@@ -179,13 +261,38 @@ bool PALETTE_CHUNK::read(std::ifstream & s) {
             && s & c.b
             && s & c.a;
         if (result && flags & 0x1) {
-            result = result && s & foobar; // throw away the color name
+            WORD nameLength;
+            result = s & nameLength
+                && s.seekg(nameLength, std::ios::cur).good(); // throw away the color name
         }
     }
     return result;
 }
 
-LAYER_CHUNK::LAYER_CHUNK(LAYER_CHUNK && layer) {
+bool PALETTE_CHUNK::write(std::ostream & s) const {
+    BYTE unused[8] = {};
+
+    if (first > last || last >= colors.size()) {
+        return false;
+    }
+    bool result = s | size
+        && s | first
+        && s | last
+        && s | unused;
+    for (DWORD i = first; i <= last && result; i++) {
+        const Color & c = colors[i];
+        WORD flags = 0; // no name
+        result = s | flags
+            && s | c.r
+            && s | c.g
+            && s | c.b
+            && s | c.a;
+    }
+    return result;
+}
+
+LAYER_CHUNK::LAYER_CHUNK(LAYER_CHUNK && layer) :
+    name(std::move(layer.name)) { // keeps the memory resource of the name
     flags = layer.flags;
     layerType = layer.layerType;
     layerChildLevel = layer.layerChildLevel;
@@ -193,10 +300,10 @@ LAYER_CHUNK::LAYER_CHUNK(LAYER_CHUNK && layer) {
     height = layer.height;
     blendMode = layer.blendMode;
     opacity = layer.opacity;
-    name = std::move(layer.name);
 }
 
-LAYER_CHUNK::LAYER_CHUNK(std::ifstream & s) {
+LAYER_CHUNK::LAYER_CHUNK(std::ifstream & s, std::pmr::memory_resource * memory) :
+    name(memory) {
     read(s);
 }
 
@@ -224,6 +331,22 @@ bool LAYER_CHUNK::read(std::ifstream & s) {
         && s & name;
 }
 
+bool LAYER_CHUNK::write(std::ostream & s) const {
+    return s | flags
+        && s | layerType
+        && s | layerChildLevel
+        && s | width
+        && s | height
+        && s | blendMode
+        && s | opacity
+        && s | unused
+        && s | name;
+}
+
+TAG::TAG(std::pmr::memory_resource * memory) :
+    name(memory) {
+}
+
 TAG::TAG(TAG && t) :
     from(t.from),
     to(t.to),
@@ -252,7 +375,21 @@ bool TAG::read(std::ifstream & s) {
         && s & name;
 }
 
-TAG_CHUNK::TAG_CHUNK(std::ifstream & s) {
+bool TAG::write(std::ostream & s) const {
+    BYTE unused[8] = {};
+    BYTE color[3] = {};
+    BYTE extra = 0;
+    return s | from
+        && s | to
+        && s | direction
+        && s | unused
+        && s | color
+        && s | extra
+        && s | name;
+}
+
+TAG_CHUNK::TAG_CHUNK(std::ifstream & s, std::pmr::memory_resource * memory) :
+    tags(memory) {
     read(s);
 }
 
@@ -270,7 +407,7 @@ bool TAG_CHUNK::read(std::ifstream & s) {
         && s & future;
     tags.reserve(count);
     for (WORD i = 0; i < count && result; ++i) {
-        TAG t;
+        TAG t(tags.get_allocator().resource());
         result = result && t.read(s);
         if (result) {
             tags.push_back(std::move(t));
@@ -279,7 +416,20 @@ bool TAG_CHUNK::read(std::ifstream & s) {
     return result;
 }
 
-SLICE_CHUNK::SLICE_CHUNK(std::ifstream & s) {
+bool TAG_CHUNK::write(std::ostream & s) const {
+    WORD count = tags.size();
+    BYTE future[8] = {};
+    bool result = s | count
+        && s | future;
+    for (const auto & t : tags) {
+        result = result && t.write(s);
+    }
+    return result;
+}
+
+SLICE_CHUNK::SLICE_CHUNK(std::ifstream & s, std::pmr::memory_resource * memory) :
+    sliceKeys(memory),
+    name(memory) {
     read(s);
 }
 
@@ -319,6 +469,38 @@ bool SLICE_CHUNK::read(std::ifstream & s) {
     return result;
 }
 
+bool SLICE_CHUNK::write(std::ostream & s) const {
+    DWORD keys = sliceKeys.size();
+    DWORD reserved = 0;
+    bool result = s | keys
+        && s | flags
+        && s | reserved
+        && s | name;
+    for (const auto & k : sliceKeys) {
+        result = result
+            && s | k.frame
+            && s | k.x
+            && s | k.y
+            && s | k.width
+            && s | k.height;
+        if (flags & 0x1) {
+            const auto & n = k.ninePatches;
+            result = result
+                && s | n.centerX
+                && s | n.centerY
+                && s | n.centerWidth
+                && s | n.centerHeight;
+        }
+        if (flags & 0x2) {
+            const auto & pivot = k.pivot;
+            result = result
+                && s | pivot.pivotX
+                && s | pivot.pivotY;
+        }
+    }
+    return result;
+}
+
 CEL_CHUNK & CEL_CHUNK::operator =(const CEL_CHUNK && cel) {
     layerIndex = cel.layerIndex;
     x = cel.x;
@@ -329,28 +511,36 @@ CEL_CHUNK & CEL_CHUNK::operator =(const CEL_CHUNK && cel) {
     width = cel.width;
     height = cel.height;
     frameLink = cel.frameLink;
+    checksum = cel.checksum;
+    skipped = cel.skipped;
+    compressed = std::move(cel.compressed);
 
     return *this;
 }
 
-CEL_CHUNK::CEL_CHUNK(CEL_CHUNK && cel) {
+CEL_CHUNK::CEL_CHUNK(CEL_CHUNK && cel) :
+    pixels(std::move(cel.pixels)), // keeps the memory resource of the pixels
+    compressed(std::move(cel.compressed)) {
     layerIndex = cel.layerIndex;
     x = cel.x;
     y = cel.y;
     opacity = cel.opacity;
     type = cel.type;
-    pixels = std::move(cel.pixels);
     width = cel.width;
     height = cel.height;
     frameLink = cel.frameLink;
+    checksum = cel.checksum;
+    skipped = cel.skipped;
 }
 
-CEL_CHUNK::CEL_CHUNK(std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize) {
-    read(s, pixelFormat, dataSize);
+CEL_CHUNK::CEL_CHUNK(std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize, ASEPRITE & aseprite) :
+    pixels(aseprite.memory),
+    compressed(aseprite.memory) {
+    read(s, pixelFormat, dataSize, aseprite);
 }
 
 // chunkSize - to tell size of compressed data
-bool CEL_CHUNK::read(std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize) {
+bool CEL_CHUNK::read(std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize, ASEPRITE & aseprite) {
     BYTE reserved[7];
     bool result = s & layerIndex
         && s & x
@@ -364,6 +554,7 @@ bool CEL_CHUNK::read(std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize) {
         return result;
     switch (type) {
     case 0: {
+        LoadStats::Scope scope(aseprite.stats, LoadStats::FILE_READ);
         result = readRawPixels(s, pixelFormat);
         break;
     }
@@ -372,7 +563,8 @@ bool CEL_CHUNK::read(std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize) {
         break;
     }
     case 2: {
-        result = readCompressedPixels(s, pixelFormat, dataSize - CEL_HEADER_SIZE);
+        result = dataSize >= CEL_HEADER_SIZE
+            && readCompressedPixels(s, pixelFormat, dataSize - CEL_HEADER_SIZE, aseprite);
         break;
     }
     default:
@@ -414,72 +606,251 @@ bool CEL_CHUNK::readRawPixels(std::ifstream & s, PIXELTYPE pixelFormat) {
 
     return result;
 }
-bool CEL_CHUNK::readCompressedPixels(std::ifstream & s, PIXELTYPE pixelFormat, DWORD sourceLen) {
-    bool result = s & width && s & height;
-    if (!result) {
-        return result;
+// identifies a compressed cel across reloads, equal data and size give equal pixels
+static uint64_t celChecksum(const BYTE * data, DWORD length, PIXELTYPE pixelFormat, WORD width, WORD height) {
+    uint64_t hash = std::hash<std::string_view>()(std::string_view((const char *) data, length));
+    uint64_t size = uint64_t(pixelFormat) << 32 | uint64_t(width) << 16 | height;
+    return hash ^ (size * 0x9E3779B97F4A7C15ull);
+}
+
+// size of the inflated pixels, 0 for an unknown format
+static DWORD inflatedSize(PIXELTYPE pixelFormat, DWORD dim) {
+    switch (pixelFormat) {
+    case INDEXED:
+        return dim;
+    case GRAYSCALE:
+        return dim * 2;
+    case RGBA:
+        return dim * 4;
+    default:
+        return 0;
     }
-    DWORD dim = width * height;
-    pixels.resize(dim);
-    sourceLen -= 4; /* width, height */
-    std::vector<BYTE> source(sourceLen);
-    s.read((char*) source.data() /*zlib header*/, sourceLen);
+}
 
-    result = s.good();
-    if (!result) {
-        return result;
+// RGBA pixels have the layout of PIXEL_DATA and are inflated in place, others go to the scratch buffer
+static BYTE * inflateTarget(CEL_CHUNK & cel, PIXELTYPE pixelFormat, DWORD expectedLen, DecoderContext & context) {
+    static_assert(sizeof(PIXEL_DATA) == 4);
+    cel.pixels.resize(cel.width * cel.height);
+    if (pixelFormat == RGBA) {
+        return (BYTE *) cel.pixels.data();
     }
+    context.uncompressed.resize(expectedLen);
+    return context.uncompressed.data();
+}
 
-    DWORD expectedLen = dim;
+// moves inflated indexed and grayscale pixels from the scratch buffer to PIXEL_DATA
+static void repack(CEL_CHUNK & cel, PIXELTYPE pixelFormat, const BYTE * uncompressed) {
+    auto & pixels = cel.pixels;
+    DWORD dim = cel.width * cel.height;
     switch (pixelFormat) {
     case INDEXED: {
+        for (DWORD i = 0; i < dim; i++) {
+            pixels[i].INDEXED = uncompressed[i];
+        }
         break;
     }
     case GRAYSCALE: {
-        expectedLen *= 2;
+        for (DWORD i = 0; i < dim; i++) {
+            pixels[i].GRAYSCALE[0] = uncompressed[2 * i];
+            pixels[i].GRAYSCALE[1] = uncompressed[2 * i + 1];
+        }
         break;
     }
     case RGBA: {
-        expectedLen *= 4;
         break;
     }
-    default:
-        result = false;
     }
-    std::vector<BYTE> uncompressed(expectedLen);
+}
+
+bool CEL_CHUNK::readCompressedPixels(std::ifstream & s, PIXELTYPE pixelFormat, DWORD sourceLen, ASEPRITE & aseprite) {
+    bool result = sourceLen >= sizeof(width) + sizeof(height)
+        && s & width && s & height;
+    if (!result) {
+        return result;
+    }
+    DWORD dim = width * height;
+    DWORD expectedLen = inflatedSize(pixelFormat, dim);
+    if (expectedLen == 0 && dim != 0) {
+        return false;
+    }
+
+    // scratch buffers are reused by all cels read with the context
+    DecoderContext & context = aseprite.context ? *aseprite.context : threadDecoderContext();
+    const Decompressor & decompressor = *aseprite.decompressor;
+    LoadStats * stats = aseprite.stats;
+    const bool checksums = aseprite.celChecksums || aseprite.knownCels;
+
+    sourceLen -= 4; /* width, height */
+
+    // read the whole stream first when it is kept or hashed, or to time reading and inflating apart
+    const BYTE * source = nullptr;
+    if (aseprite.deferInflate) {
+        compressed.resize(sourceLen);
+        source = compressed.data();
+    } else if (stats || checksums) {
+        context.source.resize(sourceLen);
+        source = context.source.data();
+    }
+    if (source) {
+        LoadStats::Scope scope(stats, LoadStats::FILE_READ);
+        result = bool(s.read((char *) source, sourceLen));
+    }
+    if (result && checksums) {
+        checksum = celChecksum(source, sourceLen, pixelFormat, width, height);
+        skipped = aseprite.knownCels
+            && std::binary_search(aseprite.knownCels->begin(), aseprite.knownCels->end(), checksum);
+        if (skipped) {
+            compressed.clear();
+            return result;
+        }
+    }
+    if (aseprite.deferInflate) {
+        // sized now, inflate() doesn't allocate from the memory of the file
+        pixels.resize(dim);
+        return result;
+    }
+    if (source) {
+        return result && inflate(source, sourceLen, pixelFormat, decompressor, context, stats);
+    }
+
+    BYTE * dest = inflateTarget(*this, pixelFormat, expectedLen, context);
+    DWORD destLen;
+    result = decompressor.uncompress(dest, expectedLen, destLen, s, sourceLen)
+        && destLen == expectedLen;
+    if (result) {
+        repack(*this, pixelFormat, dest);
+    }
+    return result;
+}
+
+bool CEL_CHUNK::inflate(const BYTE * source, DWORD sourceLen, PIXELTYPE pixelFormat, const Decompressor & decompressor,
+        DecoderContext & context, LoadStats * stats) {
+    DWORD expectedLen = inflatedSize(pixelFormat, width * height);
+    BYTE * dest = inflateTarget(*this, pixelFormat, expectedLen, context);
     DWORD destLen;
-    auto outcome = tinf_uncompress(uncompressed.data(), &destLen, source.data() + 2, sourceLen - 2 - 4/*zlib header, crc*/);
-    result = result && TINF_OK == outcome;
+    bool result;
+    {
+        LoadStats::Scope scope(stats, LoadStats::INFLATE);
+        result = decompressor.uncompress(dest, expectedLen, destLen, source, sourceLen)
+            && destLen == expectedLen;
+    }
+    if (stats) {
+        stats->bytesDecompressed += result ? destLen : 0;
+        stats->cels++;
+    }
+    if (result) {
+        LoadStats::Scope scope(stats, LoadStats::PIXEL_REPACK);
+        repack(*this, pixelFormat, dest);
+    }
+    return result;
+}
 
-    result = result && destLen == expectedLen;
+bool CEL_CHUNK::inflate(PIXELTYPE pixelFormat, const Decompressor & decompressor, DecoderContext & context) {
+    if (type != 2 || skipped) {
+        return true;
+    }
+    bool result = inflate(compressed.data(), compressed.size(), pixelFormat, decompressor, context, nullptr);
+    compressed.clear();
+    return result;
+}
 
+bool CEL_CHUNK::write(std::ostream & s, PIXELTYPE pixelFormat, int level) const {
+    BYTE reserved[7] = {};
+    bool result = s | layerIndex
+        && s | x
+        && s | y
+        && s | opacity
+        && s | type
+        && s | reserved;
     if (!result)
         return result;
+    switch (type) {
+    case 0: {
+        result = writeRawPixels(s, pixelFormat);
+        break;
+    }
+    case 1: {
+        result = s | frameLink;
+        break;
+    }
+    case 2: {
+        result = writeCompressedPixels(s, pixelFormat, level);
+        break;
+    }
+    default:
+        result = false;
+    }
+
+    return result;
+}
+
+bool CEL_CHUNK::writeRawPixels(std::ostream & s, PIXELTYPE pixelFormat) const {
+    DWORD dim = width * height;
+    bool result = pixels.size() == dim
+        && s | width && s | height;
+
+    for (DWORD i = 0; i < dim && result; i++) {
+        switch (pixelFormat) {
+        case INDEXED:
+            result = s | pixels[i].INDEXED;
+            break;
+        case GRAYSCALE:
+            result = s | pixels[i].GRAYSCALE;
+            break;
+        case RGBA:
+            result = s | pixels[i].RGBA;
+            break;
+        }
+    }
+    return result;
+}
+
+bool CEL_CHUNK::writeCompressedPixels(std::ostream & s, PIXELTYPE pixelFormat, int level) const {
+    DWORD dim = width * height;
+    if (pixels.size() != dim) {
+        return false;
+    }
+
+    // encoder state and scratch buffers are reused by all cels written on this thread
+    static thread_local std::unique_ptr<TDEFLATE_STATE> state = std::make_unique<TDEFLATE_STATE>();
+    static thread_local std::vector<BYTE> packed;
+    static thread_local std::vector<BYTE> compressed;
+
+    const BYTE * source = (const BYTE *) pixels.data();
+    DWORD sourceLen = dim * 4;
     switch (pixelFormat) {
     case INDEXED: {
+        packed.resize(dim);
         for (DWORD i = 0; i < dim; i++) {
-            pixels[i].INDEXED = uncompressed[i];
+            packed[i] = pixels[i].INDEXED;
         }
+        source = packed.data();
+        sourceLen = dim;
         break;
     }
     case GRAYSCALE: {
+        packed.resize(dim * 2);
         for (DWORD i = 0; i < dim; i++) {
-            pixels[i].GRAYSCALE[0] = uncompressed[2 * i];
-            pixels[i].GRAYSCALE[1] = uncompressed[2 * i + 1];
+            packed[2 * i] = pixels[i].GRAYSCALE[0];
+            packed[2 * i + 1] = pixels[i].GRAYSCALE[1];
         }
+        source = packed.data();
+        sourceLen = dim * 2;
         break;
     }
     case RGBA: {
-        for (DWORD i = 0; i < dim; i++) {
-            pixels[i].RGBA[0] = uncompressed[4 * i];
-            pixels[i].RGBA[1] = uncompressed[4 * i + 1];
-            pixels[i].RGBA[2] = uncompressed[4 * i + 2];
-            pixels[i].RGBA[3] = uncompressed[4 * i + 3];
-        }
         break;
     }
     }
-    return result;
+
+    compressed.resize(tdeflate_bound(sourceLen));
+    unsigned int compressedLen;
+    bool result = tdeflate_zlib_compress(state.get(), compressed.data(), compressed.size(), &compressedLen,
+            source, sourceLen, level) == TDEFLATE_OK
+        && s | width
+        && s | height;
+    s.write((const char *) compressed.data(), compressedLen);
+    return result && s.good();
 }
 
 CHUNK::CHUNK(chunk_t && data, WORD type) :
@@ -488,13 +859,58 @@ CHUNK::CHUNK(chunk_t && data, WORD type) :
 
 }
 
-CHUNK::CHUNK(CHUNK && c) {
-    data = std::move(c.data);
-    type = c.type;
+CHUNK::CHUNK(CHUNK && c) :
+    data(std::move(c.data)),
+    type(c.type) {
     c.type = 0;
 }
 
+bool CHUNK::write(std::ostream & s, PIXELTYPE pixelFormat, int level) const {
+    auto start = s.tellp();
+    DWORD size = 0; // patched below
+    bool result = s | size
+        && s | type;
+    if (!result) {
+        return result;
+    }
+    switch (type) {
+    case PALETTE_OLD_0x0004:
+    case PALETTE_OLD_0x0011: {
+        result = std::get<PALETTE_OLD_CHUNK>(data).write(s);
+        break;
+    }
+    case LAYER_0x2004: {
+        result = std::get<LAYER_CHUNK>(data).write(s);
+        break;
+    }
+    case CEL_0x2005: {
+        result = std::get<CEL_CHUNK>(data).write(s, pixelFormat, level);
+        break;
+    }
+    case FRAME_TAGS_0x2018: {
+        result = std::get<TAG_CHUNK>(data).write(s);
+        break;
+    }
+    case PALETTE_0x2019: {
+        result = std::get<PALETTE_CHUNK>(data).write(s);
+        break;
+    }
+    case SLICE_0x2022: {
+        result = std::get<SLICE_CHUNK>(data).write(s);
+        break;
+    }
+    default:
+        result = false;
+    }
+    return result && writeSize(s, start);
+}
+
+FRAME::FRAME(std::pmr::memory_resource * memory) :
+    chunks(memory) {
+}
+
 bool FRAME::read(std::ifstream & s, PIXELTYPE pixelFormat, ASEPRITE & aseprite) {
+    LoadStats::Scope scope(aseprite.stats, LoadStats::CHUNK_PARSE);
     bool result = s & size
         && s & magicNumber
         && s & chunks_old
@@ -515,6 +931,9 @@ bool FRAME::read(std::ifstream & s, PIXELTYPE pixelFormat, ASEPRITE & aseprite)
                 break;
             }
 
+            if (aseprite.stats) {
+                aseprite.stats->chunks[type]++;
+            }
             //auto p2 = s.tellg();
             //std::cout << std::hex << "0x" << p2 << ":DEBUG Chunk: size: " << size << " type: " << type << std::dec << "\n";
             switch (type) {
@@ -524,15 +943,15 @@ bool FRAME::read(std::ifstream & s, PIXELTYPE pixelFormat, ASEPRITE & aseprite)
                 break;
             }
             case LAYER_0x2004: {
-                chunks.emplace_back(LAYER_CHUNK(s), type);
+                chunks.emplace_back(LAYER_CHUNK(s, aseprite.memory), type);
                 break;
             }
             case CEL_0x2005: {
-                chunks.emplace_back(CEL_CHUNK(s, pixelFormat, size - CHUNK_HEADER_SIZE), type);
+                chunks.emplace_back(CEL_CHUNK(s, pixelFormat, size - CHUNK_HEADER_SIZE, aseprite), type);
                 break;
             }
             case FRAME_TAGS_0x2018: {
-                chunks.emplace_back(TAG_CHUNK(s), type);
+                chunks.emplace_back(TAG_CHUNK(s, aseprite.memory), type);
                 break;
             }
             case PALETTE_0x2019: {
@@ -540,7 +959,7 @@ bool FRAME::read(std::ifstream & s, PIXELTYPE pixelFormat, ASEPRITE & aseprite)
                 break;
             }
             case SLICE_0x2022: {
-                chunks.emplace_back(SLICE_CHUNK(s), type);
+                chunks.emplace_back(SLICE_CHUNK(s, aseprite.memory), type);
                 aseprite.sliceCount ++;
                 break;
             }
@@ -554,34 +973,106 @@ bool FRAME::read(std::ifstream & s, PIXELTYPE pixelFormat, ASEPRITE & aseprite)
     return result;
 }
 
-ASEPRITE::ASEPRITE(std::string filename) {
-    std::ifstream file(filename, std::ios::in | std::ios::binary);
+bool FRAME::write(std::ostream & s, PIXELTYPE pixelFormat, int level) const {
+    auto start = s.tellp();
+    DWORD size = 0; // patched below
+    WORD magic = 0xF1FA;
+    DWORD count = chunks.size();
+    WORD countOld = count < 0xFFFF ? count : 0xFFFF;
+    bool result = s | size
+        && s | magic
+        && s | countOld
+        && s | duration
+        && s | reserved
+        && s | count;
+    for (const auto & chunk : chunks) {
+        result = result && chunk.write(s, pixelFormat, level);
+    }
+    return result && writeSize(s, start);
+}
+
+ASEPRITE::ASEPRITE(const std::string & filename, const Decompressor & decompressor, LoadStats * stats,
+        std::pmr::memory_resource * memory) :
+    frames(memory),
+    decompressor(&decompressor),
+    stats(stats),
+    memory(memory),
+    context(&threadDecoderContext()) {
+    read(filename);
+}
+
+ASEPRITE::ASEPRITE(const std::string & filename, DecoderContext & context, const Decompressor & decompressor,
+        LoadStats * stats) :
+    ASEPRITE(context) {
+    this->decompressor = &decompressor;
+    this->stats = stats;
+    read(filename);
+}
+
+ASEPRITE::ASEPRITE(DecoderContext & context, std::pmr::memory_resource * memory) :
+    frames(memory ? memory : context.resetArena()),
+    memory(frames.get_allocator().resource()),
+    context(&context) {
+}
+
+bool ASEPRITE::read(const std::string & filename) {
+    LoadStats::Scope scope(stats, LoadStats::FILE_READ);
+    std::ifstream & file = context ? context->file : threadDecoderContext().file;
+    file.clear();
+    file.open(filename, std::ios::in | std::ios::binary);
     if (!file.good()) {
         std::cout << "File " << filename << " not good\n";
         file.close();
-        return;
-    }
-    if (!ASEPRITE::tinf_initialized) {
-        tinf_init();
-        ASEPRITE::tinf_initialized = true;
+        return false;
     }
-    if (file & header) {
+    bool result = file & header;
+    if (result) {
         //header.toString();
-        PIXELTYPE pixelFormat = header.bitDepth == 8 ? INDEXED : header.bitDepth == 16 ? GRAYSCALE : RGBA;
-        frames.resize(header.frames);
+        PIXELTYPE pixelFormat = header.pixelFormat();
+        frames.clear();
+        sliceCount = 0;
+        frames.reserve(header.frames);
+        for (size_t f = 0; f < header.frames; f++) {
+            frames.emplace_back(memory);
+        }
         for (size_t f = 0; f < header.frames && file.good(); f++) {
             //std::cout << " FRAME " << f << "\n";
             if(!frames[f].read(file, pixelFormat, *this)){
                 std::cout << " Failed to read FRAME " << f << " in " << filename << " ...stopping.\n";
+                result = false;
                 break;
             }
         }
+        result = result && file.good();
     }
 
+    if (stats) {
+        file.clear();
+        stats->bytesRead += file.tellg();
+    }
+    file.close();
+    return result;
+}
+
+bool ASEPRITE::write(const std::string & filename, int level) const {
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.good()) {
+        std::cout << "File " << filename << " not good\n";
+        return false;
+    }
+    ASE_HEADER h = header;
+    h.fileSize = 0; // patched below
+    h.magicNumber = 0xA5E0;
+    h.frames = frames.size();
+    bool result = file | h;
+    for (const auto & frame : frames) {
+        result = result && frame.write(file, h.pixelFormat(), level);
+    }
+    result = result && writeSize(file, 0);
     file.close();
+    return result && !file.fail();
 }
 
-bool ASEPRITE::tinf_initialized = false;
 /*
  Notes
 NOTE.1
@@ -18,8 +18,13 @@
 #include <fstream>
 #include <array>
 #include <memory>
+#include <memory_resource>
 #include <variant>
 #include "tinf/tinf.h"
+#include "tinf/tdeflate.h"
+#include "decompressor.h"
+#include "decoder_context.h"
+#include "load_stats.h"
 
 namespace aseprite {
 
@@ -29,6 +34,12 @@ bool operator & (std::ifstream & stream, OUT & out){
     return stream.good();
 }
 
+template <typename IN>
+bool operator | (std::ostream & stream, const IN & in){
+    stream.write((const char *) &in, sizeof(IN));
+    return stream.good();
+}
+
 using BYTE = uint8_t;
 using WORD = uint16_t;
 using SHORT = int16_t;
@@ -60,16 +71,22 @@ struct PIXEL {
 
 struct STRING {
     WORD length;
-    std::vector<BYTE> data;
+    std::pmr::vector<BYTE> data;
 
     STRING() = default;
 
+    explicit STRING(std::pmr::memory_resource * memory);
+
+    STRING(const std::string & string, std::pmr::memory_resource * memory = std::pmr::get_default_resource());
+
     STRING(STRING && s);
 
     STRING & operator = (const STRING && s);
 
     bool read(std::ifstream & s);
 
+    bool write(std::ostream & s) const;
+
     std::string toString() const;
 };
 
@@ -81,7 +98,7 @@ public:
     WORD width; //pixels
     WORD height; //pixels
     WORD bitDepth; //8 / 16/ 32
-    DWORD flags; // 1 - layer opacity has valid value
+    DWORD flags; // 1 - layer opacity has valid value, 2 - opacity of group layers is valid
 
     WORD speed; // in milliseconds. deprecated use frame duration
     DWORD stuff_0; // zero
@@ -99,6 +116,10 @@ public:
 
     bool read(std::ifstream & s);
 
+    bool write(std::ostream & s) const;
+
+    PIXELTYPE pixelFormat() const;
+
     void toString();
 };
 
@@ -135,11 +156,18 @@ struct PALETTE_OLD_CHUNK {
     PALETTE_OLD_CHUNK & operator = (const PALETTE_OLD_CHUNK && palatte);
 
     bool read(std::ifstream & s);
+
+    bool write(std::ostream & s) const;
 };
 
 struct PALETTE_CHUNK {
+    DWORD size = UINT8_MAX + 1; // total number of entries
+    DWORD first = 0; // entries first..last are in the chunk, the others keep colors of the previous frame
+    DWORD last = UINT8_MAX;
     std::array<Color, UINT8_MAX + 1> colors;
 
+    PALETTE_CHUNK() = default;
+
     PALETTE_CHUNK(PALETTE_CHUNK && palette);
 
     PALETTE_CHUNK(std::ifstream & s);
@@ -147,6 +175,8 @@ struct PALETTE_CHUNK {
     PALETTE_CHUNK & operator = (const PALETTE_CHUNK && palette);
 
     bool read (std::ifstream & s);
+
+    bool write(std::ostream & s) const;
 };
 
 struct LAYER_CHUNK {
@@ -186,13 +216,17 @@ struct LAYER_CHUNK {
     BYTE unused[3];
     STRING name;
 
+    LAYER_CHUNK() = default;
+
     LAYER_CHUNK(LAYER_CHUNK && layer);
 
-    LAYER_CHUNK(std::ifstream & s);
+    LAYER_CHUNK(std::ifstream & s, std::pmr::memory_resource * memory = std::pmr::get_default_resource());
 
     LAYER_CHUNK & operator = (const LAYER_CHUNK && layer);
 
     bool read(std::ifstream & s);
+
+    bool write(std::ostream & s) const;
 };
 
 struct TAG {
@@ -203,22 +237,30 @@ struct TAG {
 
     TAG() = default;
 
+    explicit TAG(std::pmr::memory_resource * memory);
+
     TAG(TAG && t);
 
     TAG & operator = (const TAG && t);
 
     bool read(std::ifstream & s);
+
+    bool write(std::ostream & s) const;
 };
 
 struct TAG_CHUNK {
-    std::vector<TAG> tags;
-    TAG_CHUNK(std::ifstream & s);
+    std::pmr::vector<TAG> tags;
+    TAG_CHUNK() = default;
+
+    TAG_CHUNK(std::ifstream & s, std::pmr::memory_resource * memory = std::pmr::get_default_resource());
 
     TAG_CHUNK(TAG_CHUNK && tag);
 
     TAG_CHUNK & operator = (TAG_CHUNK && tag);
 
     bool read (std::ifstream & s);
+
+    bool write(std::ostream & s) const;
 };
 
 struct SLICE_KEY {
@@ -245,39 +287,68 @@ struct SLICE_KEY {
 };
 
 struct SLICE_CHUNK {
-    std::vector<SLICE_KEY> sliceKeys;
+    std::pmr::vector<SLICE_KEY> sliceKeys;
     DWORD count;
     DWORD flags;
     STRING name;
 
-    SLICE_CHUNK(std::ifstream & s);
+    SLICE_CHUNK() = default;
+
+    SLICE_CHUNK(std::ifstream & s, std::pmr::memory_resource * memory = std::pmr::get_default_resource());
 
     bool read(std::ifstream & s);
+
+    bool write(std::ostream & s) const;
 };
 
+struct ASEPRITE;
+
 struct CEL_CHUNK {
     WORD layerIndex; // see NOTE.2
     SHORT x;
     SHORT y;
     BYTE opacity;
     WORD type; // 0 - raw cel, 1 - linked cel, 2 - compressed
-    std::vector<PIXEL_DATA> pixels;
+    std::pmr::vector<PIXEL_DATA> pixels;
 
     WORD width = 0; //type == 0,2
     WORD height = 0; // type == 0,2
     WORD frameLink; // type == 1
+    uint64_t checksum = 0; // type == 2, of the compressed data and size, see ASEPRITE::celChecksums
+    bool skipped = false; // type == 2, found in ASEPRITE::knownCels, pixels were not decoded
+    std::pmr::vector<BYTE> compressed; // type == 2, zlib stream until inflate(), see ASEPRITE::deferInflate
 
     CEL_CHUNK & operator =(const CEL_CHUNK && cel);
 
+    CEL_CHUNK() = default;
+
     CEL_CHUNK(CEL_CHUNK && cel);
 
-    CEL_CHUNK(std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize);
+    // decompressor, stats, memory and scratch buffers are those of the file being read
+    CEL_CHUNK(std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize, ASEPRITE & aseprite);
 
-    bool read (std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize);
+    bool read (std::ifstream & s, PIXELTYPE pixelFormat, DWORD dataSize, ASEPRITE & aseprite);
 
     bool readRawPixels(std::ifstream & s, PIXELTYPE pixelFormat);
 
-    bool readCompressedPixels(std::ifstream & s, PIXELTYPE pixelFormat, DWORD sourceLen);
+    bool readCompressedPixels(std::ifstream & s, PIXELTYPE pixelFormat, DWORD sourceLen, ASEPRITE & aseprite);
+
+    /**
+     * Decodes a cel read with ASEPRITE::deferInflate, the pixels are already sized so cels of
+     * a file can be inflated on several threads at once (each with its own context).
+     * Does nothing for other cels.
+     */
+    bool inflate(PIXELTYPE pixelFormat, const Decompressor & decompressor, DecoderContext & context = threadDecoderContext());
+
+    bool inflate(const BYTE * source, DWORD sourceLen, PIXELTYPE pixelFormat, const Decompressor & decompressor,
+        DecoderContext & context, LoadStats * stats);
+
+    // type 2 cels are compressed with given tdeflate level
+    bool write(std::ostream & s, PIXELTYPE pixelFormat, int level) const;
+
+    bool writeRawPixels(std::ostream & s, PIXELTYPE pixelFormat) const;
+
+    bool writeCompressedPixels(std::ostream & s, PIXELTYPE pixelFormat, int level) const;
 };
 
 struct CHUNK {
@@ -297,8 +368,9 @@ struct CHUNK {
     CHUNK(chunk_t && data, WORD type);
 
     CHUNK(CHUNK && c);
+
+    bool write(std::ostream & s, PIXELTYPE pixelFormat, int level) const;
 };
-struct ASEPRITE;
 
 struct FRAME {
     DWORD size; // bytes
@@ -307,18 +379,71 @@ struct FRAME {
     WORD duration; // in milliseconds
     BYTE reserved[2]; // 0
     DWORD chunkCount; // if zero, use chunks_old
-    std::vector<CHUNK> chunks;
+    std::pmr::vector<CHUNK> chunks;
+
+    FRAME() = default;
+
+    explicit FRAME(std::pmr::memory_resource * memory);
 
     bool read(std::ifstream & s, PIXELTYPE pixelFormat, ASEPRITE & aseprite);
+
+    bool write(std::ostream & s, PIXELTYPE pixelFormat, int level) const;
 };
 
+/**
+ * Containers of the parsed file are std::pmr vectors allocated from the memory resource given
+ * to the constructor. With a monotonic arena the whole file is released at once,
+ * Animation::loadAseImage reads into the arena of a DecoderContext.
+ */
 struct ASEPRITE {
     ASE_HEADER header;
-    std::vector<FRAME> frames;
+    std::pmr::vector<FRAME> frames;
     size_t sliceCount = 0;
-    ASEPRITE(std::string filename);
-private:
-    static bool tinf_initialized;
+    const Decompressor * decompressor = &defaultDecompressor();
+    LoadStats * stats = nullptr; // filled while loading when set
+    std::pmr::memory_resource * memory = std::pmr::get_default_resource(); // of the frames and chunks, must outlive them
+    DecoderContext * context = nullptr; // buffers used while reading, nullptr -> threadDecoderContext()
+
+    /**
+     * For reloading: compressed cels get a checksum, those in knownCels (sorted) are not inflated.
+     * Set them before read().
+     */
+    bool celChecksums = false;
+    const std::vector<uint64_t> * knownCels = nullptr;
+
+    /**
+     * Compressed cels are read but not inflated, call CEL_CHUNK::inflate on them.
+     */
+    bool deferInflate = false;
+
+    ASEPRITE() = default;
+
+    /**
+     * Nothing is read yet, frames will be allocated from memory or the arena of the context.
+     */
+    explicit ASEPRITE(DecoderContext & context, std::pmr::memory_resource * memory = nullptr);
+
+    ASEPRITE(const std::string & filename, const Decompressor & decompressor = defaultDecompressor(), LoadStats * stats = nullptr,
+        std::pmr::memory_resource * memory = std::pmr::get_default_resource());
+
+    /**
+     * Reads the file into the arena of the context, the data is valid until the context is used
+     * for another file. A reused context reads files without allocating.
+     */
+    ASEPRITE(const std::string & filename, DecoderContext & context, const Decompressor & decompressor = defaultDecompressor(),
+        LoadStats * stats = nullptr);
+
+    /**
+     * Writes the file, frame and chunk counts and sizes are taken from the data.
+     * Chunks which were skipped when reading (user data, color profile, ...) are not written.
+     * Returns false on I/O error or when a cel doesn't match its size.
+     */
+    bool write(const std::string & filename, int level = TDEFLATE_DEFAULT_LEVEL) const;
+
+    /**
+     * False when the file can't be opened or a frame fails to read, the frames read so far are kept.
+     */
+    bool read(const std::string & filename);
 };
 
 
@@ -5,12 +5,178 @@
  *
  */
 #include <string>
+#include <algorithm>
 #include "animation.h"
 #include "aseprite.h"
 #include "aseprite_to_animation.h"
 
-animation::Animation animation::Animation::loadAseImage(const std::string &path) {
-    return fromASEPRITE(aseprite::ASEPRITE(path));
+aseprite::ASEPRITE makeReader(const animation::LoadOptions & options) {
+    // the parsed file is only needed until it is converted, the arena of the context is reused by the next load
+    auto & context = options.context ? *options.context : aseprite::threadDecoderContext();
+    aseprite::ASEPRITE ase(context, options.memory);
+    ase.decompressor = options.decompressor ? options.decompressor : &aseprite::defaultDecompressor();
+    ase.stats = options.stats;
+    ase.celChecksums = options.celChecksums;
+    return ase;
+}
+animation::Animation animation::Animation::loadAseImage(const std::string &path, const LoadOptions & options) {
+    aseprite::ASEPRITE ase = makeReader(options);
+    ase.read(path);
+    aseprite::LoadStats::Scope scope(options.stats, aseprite::LoadStats::CONVERT);
+    return fromASEPRITE(ase, options);
+}
+bool animation::Animation::reloadAseImage(const std::string &path, const LoadOptions & options) {
+    // images known by checksum, not when masks, runs or pixels were not kept for them as the options ask
+    FlatHashMap<uint64_t, uint32_t> oldImages;
+    std::vector<uint64_t> known;
+    const bool rle = options.rleImages;
+    const bool rleOnlyNow = rle && options.rleOnly;
+    if (options.collisionMasks == (masks.size() == images.size() && !images.empty())
+        && (!options.collisionMasks || options.maskAlphaThreshold == maskAlphaThreshold)
+        && rle == (rleImages.size() == images.size() && !images.empty()) && rleOnlyNow == rleOnly) {
+        for (size_t i = 0; i < imageChecksums.size() && i < images.size(); i++) {
+            if (imageChecksums[i] != 0 && !oldImages.contains(imageChecksums[i])) {
+                oldImages[imageChecksums[i]] = i;
+                known.push_back(imageChecksums[i]);
+            }
+        }
+        std::sort(known.begin(), known.end());
+    }
+
+    aseprite::ASEPRITE ase = makeReader(options);
+    ase.knownCels = &known;
+    if (!ase.read(path)) {
+        return false;
+    }
+    aseprite::LoadStats::Scope scope(options.stats, aseprite::LoadStats::CONVERT);
+    // skipped cels come out as images without pixels (and empty runs), decoded ones drop theirs below
+    LoadOptions freshOptions = options;
+    freshOptions.rleOnly = false;
+    Animation fresh = fromASEPRITE(ase, freshOptions);
+
+    // skipped cels keep their old slot
+    const size_t count = fresh.images.size();
+    std::vector<uint32_t> slot(count);
+    std::vector<bool> used(images.size());
+    std::vector<bool> reused(count);
+    for (size_t i = 0; i < count; i++) {
+        const Image & image = fresh.images[i];
+        if (image.pixels.size() != size_t(image.width) * image.height) {
+            slot[i] = *oldImages.find(fresh.imageChecksums[i]);
+            used[slot[i]] = true;
+            reused[i] = true;
+        }
+    }
+    std::vector<uint32_t> freeSlots;
+    for (size_t i = images.size(); i-- > 0;) {
+        if (!used[i]) {
+            freeSlots.push_back(i); // lowest index last
+        }
+    }
+    size_t size = images.size();
+    for (size_t i = 0; i < count; i++) {
+        if (!reused[i]) {
+            if (freeSlots.empty()) {
+                slot[i] = size++;
+            } else {
+                slot[i] = freeSlots.back();
+                freeSlots.pop_back();
+            }
+        }
+    }
+    images.resize(size);
+    imageChecksums.resize(size);
+    masks.resize(options.collisionMasks ? size : 0);
+    rleImages.resize(rle ? size : 0);
+    std::vector<bool> dropped(size);
+    for (uint32_t i : freeSlots) {
+        images[i] = Image();
+        imageChecksums[i] = 0;
+        if (options.collisionMasks) {
+            masks[i] = CollisionMask();
+        }
+        if (rle) {
+            rleImages[i] = RleImage();
+        }
+        dropped[i] = true;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!reused[i]) {
+            images[slot[i]] = std::move(fresh.images[i]);
+            imageChecksums[slot[i]] = fresh.imageChecksums[i];
+            if (options.collisionMasks) {
+                masks[slot[i]] = std::move(fresh.masks[i]);
+            }
+            if (rle) {
+                rleImages[slot[i]] = std::move(fresh.rleImages[i]);
+                if (rleOnlyNow) {
+                    std::vector<uint8_t>().swap(images[slot[i]].pixels);
+                }
+            }
+        }
+    }
+    // unused slots at the end can go, no cel refers to them
+    while (!dropped.empty() && dropped.back()) {
+        dropped.pop_back();
+        images.pop_back();
+        imageChecksums.pop_back();
+        if (options.collisionMasks) {
+            masks.pop_back();
+        }
+        if (rle) {
+            rleImages.pop_back();
+        }
+    }
+
+    for (auto & layer : fresh.layers) {
+        for (auto & cel : layer.frames) {
+            if (cel.image != Cel::NO_IMAGE) {
+                cel.image = slot[cel.image];
+            }
+        }
+    }
+    // runs and masks of kept indexed images were made with the old transparent index
+    const bool indexedMasks = options.collisionMasks && ase.header.bitDepth == 8;
+    if ((rle || indexedMasks) && fresh.transparentIndex != transparentIndex) {
+        for (size_t i = 0; i < used.size(); i++) {
+            if (!used[i]) {
+                continue;
+            }
+            const Image decoded = rleOnly ? rleImages[i].decode(transparentIndex) : Image();
+            const Image & image = rleOnly ? decoded : images[i];
+            if (rle) {
+                rleImages[i] = RleImage::encode(image, fresh.transparentIndex);
+            }
+            if (indexedMasks) {
+                masks[i] = CollisionMask::fromIndexed(image, fresh.transparentIndex);
+            }
+        }
+    }
+    width = fresh.width;
+    height = fresh.height;
+    framesCount = fresh.framesCount;
+    transparentIndex = fresh.transparentIndex;
+    rleOnly = rleOnlyNow;
+    maskAlphaThreshold = fresh.maskAlphaThreshold;
+    premultiplied = fresh.premultiplied;
+    palette = fresh.palette;
+    palettes = std::move(fresh.palettes);
+    framePalettes = std::move(fresh.framePalettes);
+    animations = std::move(fresh.animations);
+    frames = std::move(fresh.frames);
+    layers = std::move(fresh.layers);
+    loops = std::move(fresh.loops);
+    slices = std::move(fresh.slices);
+    names = std::move(fresh.names);
+    animationLookup = std::move(fresh.animationLookup);
+    sliceLookup = std::move(fresh.sliceLookup);
+    layerLookup = std::move(fresh.layerLookup);
+    buildFrameCels();
+    generation++;
+    return true;
+}
+bool animation::Animation::saveAseImage(const std::string &path, int level) const {
+    return toASEPRITE(*this).write(path, level);
 }
 animation::LoopType from(uint16_t type) {
     switch (type) {
@@ -24,31 +190,24 @@ animation::LoopType from(uint16_t type) {
         return animation::LoopType::FORWARD;
     }
 }
-std::vector<uint8_t> from(const std::vector<aseprite::PIXEL_DATA> & in) {
+std::vector<uint8_t> from(const std::pmr::vector<aseprite::PIXEL_DATA> & in) {
     std::vector<uint8_t> result(in.size());
     for (size_t i = 0; i < in.size(); i++) {
         result[i] = in[i].INDEXED;
     }
     return result;
 }
-animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase) {
+animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase, const animation::LoadOptions & options) {
     animation::Animation animation;
     animation.width = ase.header.width;
     animation.height = ase.header.height;
     animation.framesCount = ase.header.frames;
     animation.transparentIndex = ase.header.transparentIndex;
-    animation.frames.reserve(animation.framesCount);
+    animation.maskAlphaThreshold = options.collisionMasks ? options.maskAlphaThreshold : 0;
+    animation.frames.resize(animation.framesCount);
     animation.slices.reserve(ase.sliceCount);
+    const bool checksums = ase.celChecksums || ase.knownCels;
     for (const auto & chunk : ase.frames[0].chunks) {
-        if (chunk.type == aseprite::CHUNK_TYPE::PALETTE_0x2019) {
-            const auto & palette_chunk = std::get<aseprite::PALETTE_CHUNK>(chunk.data);
-            for (size_t i = 0; i < palette_chunk.colors.size(); i++) {
-                animation.palette.colors[i].r = palette_chunk.colors[i].r;
-                animation.palette.colors[i].g = palette_chunk.colors[i].g;
-                animation.palette.colors[i].b = palette_chunk.colors[i].b;
-                animation.palette.colors[i].a = palette_chunk.colors[i].a;
-            }
-        }
         if (chunk.type == aseprite::CHUNK_TYPE::FRAME_TAGS_0x2018) {
             const auto & tag_chunk = std::get<aseprite::TAG_CHUNK>(chunk.data);
             animation.loops.reserve(tag_chunk.tags.size());
@@ -63,18 +222,33 @@ animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase) {
         }
         if (chunk.type == aseprite::CHUNK_TYPE::LAYER_0x2004) {
             const auto & layer = std::get<aseprite::LAYER_CHUNK>(chunk.data);
+            // older files have no group opacity, groups would hide their children otherwise
+            const bool opacityValid = layer.layerType == 1 ? (ase.header.flags & 0x3) == 0x3 : ase.header.flags & 0x1;
             animation.layers.emplace_back(
                 animation::Layer::BLEND_MODE(layer.blendMode),
                 layer.flags & 0x1,
                 layer.layerType == 1,
-                layer.opacity,
+                opacityValid ? layer.opacity : 255,
                 layer.name.toString(),
-                animation.framesCount);
+                animation.framesCount).childLevel = layer.layerChildLevel;
         }
     }
+    animation::Palette palette{};
+    animation.framePalettes.resize(animation.framesCount);
     for (uint32_t f = 0; f < animation.framesCount; f++) {
         animation.frames[f].duration = ase.frames[f].duration;
+        bool paletteChanged = f == 0;
         for (const auto & chunk : ase.frames[f].chunks) {
+            if (chunk.type == aseprite::CHUNK_TYPE::PALETTE_0x2019) {
+                const auto & palette_chunk = std::get<aseprite::PALETTE_CHUNK>(chunk.data);
+                for (size_t i = palette_chunk.first; i <= palette_chunk.last && i < palette_chunk.colors.size(); i++) {
+                    palette.colors[i].r = palette_chunk.colors[i].r;
+                    palette.colors[i].g = palette_chunk.colors[i].g;
+                    palette.colors[i].b = palette_chunk.colors[i].b;
+                    palette.colors[i].a = palette_chunk.colors[i].a;
+                }
+                paletteChanged = true;
+            }
             if (chunk.type == aseprite::CHUNK_TYPE::SLICE_0x2022) {
                 const auto & slice_chunk = std::get<aseprite::SLICE_CHUNK>(chunk.data);
                 std::vector<animation::Slice::Key> sliceKeys;
@@ -96,7 +270,7 @@ animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase) {
                         pivot.y = key.pivot.pivotY;
                     }
                     sliceKeys.emplace_back(animation::Slice::Key{
-                        .frame = f,
+                        .frame = key.frame,
                         .x = key.x,
                         .y = key.y,
                         .width = key.width,
@@ -106,13 +280,17 @@ animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase) {
                     });
                 }
 
+                std::stable_sort(sliceKeys.begin(), sliceKeys.end(),
+                    [](const auto & a, const auto & b) { return a.frame < b.frame; });
                 auto &slice = animation.slices.emplace_back(
                         animation::Slice{
                                 .name = slice_chunk.name.toString(),
-                                .sliceKeys = std::move(sliceKeys)
+                                .sliceKeys = std::move(sliceKeys),
+                                .frameKeys = {} // filled by buildKeyIndex
                         }
                 );
-                animation.sliceLookup[slice.name] = animation.slices.size() - 1;
+                slice.buildKeyIndex(animation.framesCount);
+                animation.sliceLookup[animation.names.intern(slice.name)] = animation.slices.size() - 1;
             }
 
             if (chunk.type == aseprite::CHUNK_TYPE::CEL_0x2005) {
@@ -135,9 +313,74 @@ animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase) {
                         cel_chunk.height,
                         from(cel_chunk.pixels));
                     cel.image = animation.images.size() - 1;
+                    if (checksums) {
+                        animation.imageChecksums.push_back(cel_chunk.checksum);
+                    }
+                    if (cel_chunk.skipped) {
+                        // no pixels, the caller has the image (reloadAseImage)
+                        if (options.collisionMasks) {
+                            animation.masks.emplace_back();
+                        }
+                    } else if (options.collisionMasks) {
+                        static_assert(sizeof(aseprite::PIXEL_DATA) == 4);
+                        if (ase.header.bitDepth == 32) {
+                            animation.masks.push_back(animation::CollisionMask::fromRGBA(
+                                cel_chunk.width,
+                                cel_chunk.height,
+                                reinterpret_cast<const uint8_t *>(cel_chunk.pixels.data()),
+                                options.maskAlphaThreshold));
+                        } else if (ase.header.bitDepth == 16) {
+                            animation.masks.push_back(animation::CollisionMask::fromGrayscale(
+                                cel_chunk.width,
+                                cel_chunk.height,
+                                reinterpret_cast<const uint8_t *>(cel_chunk.pixels.data()),
+                                options.maskAlphaThreshold));
+                        } else {
+                            animation.masks.push_back(animation::CollisionMask::fromIndexed(
+                                animation.images.back(),
+                                animation.transparentIndex));
+                        }
+                    }
                 }
             }
         }
+        if (paletteChanged) {
+            // frames cycling through palettes share them
+            auto & palettes = animation.palettes;
+            auto found = std::find(palettes.begin(), palettes.end(), palette);
+            animation.framePalettes[f] = found - palettes.begin();
+            if (found == palettes.end()) {
+                palettes.push_back(palette);
+            }
+        } else {
+            animation.framePalettes[f] = animation.framePalettes[f - 1];
+        }
+    }
+    if (!animation.palettes.empty()) {
+        animation.palette = animation.palettes[0];
+    }
+    if (animation.palettes.size() < 2) {
+        animation.palettes.clear();
+        animation.framePalettes.clear();
+    }
+    if (options.rleImages) {
+        animation.rleImages.reserve(animation.images.size());
+        for (auto & image : animation.images) {
+            animation.rleImages.push_back(animation::RleImage::encode(image, animation.transparentIndex));
+            if (options.rleOnly) {
+                std::vector<uint8_t>().swap(image.pixels);
+            }
+        }
+        animation.rleOnly = options.rleOnly;
+    }
+    if (options.premultipliedAlpha) {
+        animation.premultiplied = true;
+        animation.palette.premultiply();
+        animation.palette.colors[animation.transparentIndex] = animation::Color{0, 0, 0, 0};
+        for (auto & palette : animation.palettes) {
+            palette.premultiply();
+            palette.colors[animation.transparentIndex] = animation::Color{0, 0, 0, 0};
+        }
     }
     if(animation.loops.empty() && animation.framesCount > 0){
         std::vector<int32_t> animationLoop;
@@ -150,7 +393,7 @@ animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase) {
         animationLoop.push_back(-1);
         animationLoop.push_back(0);
         animation.animations.push_back(animationLoop);
-        animation.animationLookup[""] = animation.animations.size() - 1;
+        animation.animationLookup[animation.names.intern("")] = animation.animations.size() - 1;
     }
     for (const auto & loop : animation.loops) {
         std::vector<int32_t> animationLoop;
@@ -190,7 +433,187 @@ animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase) {
         animationLoop.push_back(-1);
         animationLoop.push_back(0);
         animation.animations.push_back(animationLoop);
-        animation.animationLookup[loop.name] = animation.animations.size() - 1;
+        animation.animationLookup[animation.names.intern(loop.name)] = animation.animations.size() - 1;
+    }
+    animation.layerLookup.reserve(animation.layers.size());
+    for (size_t l = 0; l < animation.layers.size(); l++) {
+        animation::NameHandle name = animation.names.intern(animation.layers[l].name);
+        if (!animation.layerLookup.contains(name)) {
+            animation.layerLookup[name] = l;
+        }
     }
+    animation.buildLayerTree();
+    animation.buildFrameCels();
     return animation;
 }
+uint8_t to(animation::LoopType type) {
+    switch (type) {
+    case animation::LoopType::FORWARD:
+        return 0;
+    case animation::LoopType::REVERSE:
+        return 1;
+    case animation::LoopType::PING_PONG:
+        return 2;
+    default:
+        return 0;
+    }
+}
+std::pmr::vector<aseprite::PIXEL_DATA> to(const std::vector<uint8_t> & in) {
+    std::pmr::vector<aseprite::PIXEL_DATA> result(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        result[i].INDEXED = in[i];
+    }
+    return result;
+}
+aseprite::ASEPRITE toASEPRITE(const animation::Animation & animation) {
+    aseprite::ASEPRITE ase;
+    auto & header = ase.header;
+    header = aseprite::ASE_HEADER{};
+    header.magicNumber = 0xA5E0;
+    header.frames = animation.framesCount;
+    header.width = animation.width;
+    header.height = animation.height;
+    header.bitDepth = 8;
+    header.flags = 0x1 | 0x2; // opacity of layers and group layers is valid
+    header.speed = animation.framesCount > 0 ? animation.frames[0].duration : 100;
+    header.transparentIndex = animation.transparentIndex;
+    header.colorsCount = animation.palette.colors.size();
+    header.pixelWidth = 1;
+    header.pixelHeight = 1;
+
+    ase.frames.resize(animation.framesCount);
+    for (uint32_t f = 0; f < animation.framesCount; f++) {
+        auto & frame = ase.frames[f];
+        frame.magicNumber = 0xF1FA;
+        frame.duration = animation.frames[f].duration;
+        frame.reserved[0] = frame.reserved[1] = 0;
+    }
+    if (ase.frames.empty()) {
+        return ase;
+    }
+
+    auto & chunks = ase.frames[0].chunks;
+    aseprite::PALETTE_CHUNK palette_chunk;
+    for (size_t i = 0; i < palette_chunk.colors.size(); i++) {
+        palette_chunk.colors[i].r = animation.palette.colors[i].r;
+        palette_chunk.colors[i].g = animation.palette.colors[i].g;
+        palette_chunk.colors[i].b = animation.palette.colors[i].b;
+        palette_chunk.colors[i].a = animation.palette.colors[i].a;
+    }
+    chunks.emplace_back(std::move(palette_chunk), aseprite::CHUNK_TYPE::PALETTE_0x2019);
+    // later frames change the entries from the first to the last changed one
+    for (uint32_t f = 1; f < animation.framesCount; f++) {
+        const auto & previous = animation.getFramePalette(f - 1).colors;
+        const auto & palette = animation.getFramePalette(f).colors;
+        size_t first = 0;
+        while (first < palette.size() && palette[first] == previous[first]) {
+            first++;
+        }
+        if (first == palette.size()) {
+            continue;
+        }
+        size_t last = palette.size() - 1;
+        while (palette[last] == previous[last]) {
+            last--;
+        }
+        aseprite::PALETTE_CHUNK change;
+        change.first = first;
+        change.last = last;
+        for (size_t i = first; i <= last; i++) {
+            change.colors[i].r = palette[i].r;
+            change.colors[i].g = palette[i].g;
+            change.colors[i].b = palette[i].b;
+            change.colors[i].a = palette[i].a;
+        }
+        ase.frames[f].chunks.emplace_back(std::move(change), aseprite::CHUNK_TYPE::PALETTE_0x2019);
+    }
+
+    for (const auto & layer : animation.layers) {
+        aseprite::LAYER_CHUNK layer_chunk;
+        layer_chunk.flags = (layer.visible ? 0x1 : 0) | 0x2 /* editable */;
+        layer_chunk.layerType = layer.isGroupLayer ? 1 : 0;
+        layer_chunk.layerChildLevel = layer.childLevel;
+        layer_chunk.width = 0;
+        layer_chunk.height = 0;
+        layer_chunk.blendMode = layer.blendMode;
+        layer_chunk.opacity = layer.opacity;
+        layer_chunk.unused[0] = layer_chunk.unused[1] = layer_chunk.unused[2] = 0;
+        layer_chunk.name = aseprite::STRING(layer.name);
+        chunks.emplace_back(std::move(layer_chunk), aseprite::CHUNK_TYPE::LAYER_0x2004);
+    }
+
+    if (!animation.loops.empty()) {
+        aseprite::TAG_CHUNK tag_chunk;
+        tag_chunk.tags.reserve(animation.loops.size());
+        for (const auto & loop : animation.loops) {
+            aseprite::TAG tag;
+            tag.from = loop.from;
+            tag.to = loop.to;
+            tag.direction = to(loop.loopType);
+            tag.name = aseprite::STRING(loop.name);
+            tag_chunk.tags.push_back(std::move(tag));
+        }
+        chunks.emplace_back(std::move(tag_chunk), aseprite::CHUNK_TYPE::FRAME_TAGS_0x2018);
+    }
+
+    for (const auto & slice : animation.slices) {
+        aseprite::SLICE_CHUNK slice_chunk;
+        slice_chunk.count = slice.sliceKeys.size();
+        slice_chunk.flags = 0;
+        slice_chunk.name = aseprite::STRING(slice.name);
+        slice_chunk.sliceKeys.reserve(slice.sliceKeys.size());
+        for (const auto & key : slice.sliceKeys) {
+            const auto & n = key.ninePatch;
+            if (n.x || n.y || n.width || n.height) {
+                slice_chunk.flags |= 0x01;
+            }
+            if (key.pivot.x || key.pivot.y) {
+                slice_chunk.flags |= 0x02;
+            }
+            slice_chunk.sliceKeys.push_back(aseprite::SLICE_KEY{
+                .frame = key.frame,
+                .x = key.x,
+                .y = key.y,
+                .width = key.width,
+                .height = key.height,
+                .ninePatches = {n.x, n.y, n.width, n.height},
+                .pivot = {key.pivot.x, key.pivot.y}
+            });
+        }
+        chunks.emplace_back(std::move(slice_chunk), aseprite::CHUNK_TYPE::SLICE_0x2022);
+    }
+
+    for (size_t l = 0; l < animation.layers.size(); l++) {
+        const auto & layer = animation.layers[l];
+        // image -> first frame of this layer showing it
+        animation::FlatHashMap<uint32_t, uint16_t> written;
+        for (uint32_t f = 0; f < layer.frames.size() && f < animation.framesCount; f++) {
+            const auto & cel = layer.frames[f];
+            if (cel.image == animation::Cel::NO_IMAGE) {
+                continue;
+            }
+            aseprite::CEL_CHUNK cel_chunk;
+            cel_chunk.layerIndex = l;
+            cel_chunk.x = cel.x;
+            cel_chunk.y = cel.y;
+            cel_chunk.opacity = cel.opacity;
+            const uint16_t * first = written.find(cel.image);
+            const auto * linked = first ? &layer.frames[*first] : nullptr;
+            if (linked && linked->x == cel.x && linked->y == cel.y && linked->opacity == cel.opacity) {
+                cel_chunk.type = 1;
+                cel_chunk.frameLink = *first;
+            } else {
+                const animation::Image image = animation.decodedImage(cel.image);
+                cel_chunk.type = 2;
+                cel_chunk.width = image.width;
+                cel_chunk.height = image.height;
+                cel_chunk.pixels = to(image.pixels);
+                if (!first) {
+                    written[cel.image] = f;
+                }
+            }
+            ase.frames[f].chunks.emplace_back(std::move(cel_chunk), aseprite::CHUNK_TYPE::CEL_0x2005);
+        }
+    }
+    return ase;
+}
@@ -12,7 +12,24 @@
 
 animation::LoopType from(uint16_t type);
 
-std::vector<uint8_t> from(const std::vector<aseprite::PIXEL_DATA> & in);
+std::vector<uint8_t> from(const std::pmr::vector<aseprite::PIXEL_DATA> & in);
 
-animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase);
+/**
+ * Reader set up for a load with the options: their decompressor, stats and cel checksums, the file
+ * parsed into options.memory or the arena of options.context (the thread's context by default).
+ * Every load path starts with it, call read() on the result.
+ */
+aseprite::ASEPRITE makeReader(const animation::LoadOptions & options);
+
+animation::Animation fromASEPRITE(const aseprite::ASEPRITE & ase, const animation::LoadOptions & options = animation::LoadOptions());
+
+uint8_t to(animation::LoopType type);
+
+std::pmr::vector<aseprite::PIXEL_DATA> to(const std::vector<uint8_t> & in);
+
+/**
+ * Indexed sprite with the layers, cels, tags and slices of the animation.
+ * Cels reusing the image, position and opacity of an earlier cel of the same layer are written as linked cels.
+ */
+aseprite::ASEPRITE toASEPRITE(const animation::Animation & animation);
 #endif /* ASEPRITE_TO_ANIMATION_H_ */
@@ -0,0 +1,203 @@
+/*
+ * Loading sprites in the background
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#include <cstddef>
+#include <exception>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+#include "aseprite.h"
+#include "aseprite_to_animation.h"
+#include "async_loader.h"
+
+namespace animation {
+
+// pixel bytes inflated by one task, smaller cels are batched together
+constexpr size_t INFLATE_BATCH_SIZE = 256 * 1024;
+
+struct AsyncLoader::Job {
+    std::string path;
+    LoadOptions options;
+    int priority;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+    std::shared_ptr<std::atomic<bool>> closing;
+    std::promise<std::optional<Animation>> promise;
+
+    std::unique_ptr<aseprite::DecoderContext> context; // from parse to convert, its arena has the parsed file
+    std::optional<aseprite::ASEPRITE> ase;
+    std::vector<std::vector<aseprite::CEL_CHUNK *>> batches;
+    std::atomic<size_t> remaining{0}; // batches not inflated yet
+    std::atomic<bool> failed{false};
+    std::exception_ptr error; // thrown by a batch, set by the one that set failed
+
+    bool stopped() const {
+        return cancelled->load() || closing->load();
+    }
+};
+
+AsyncLoader::AsyncLoader(unsigned threads) :
+    closing(std::make_shared<std::atomic<bool>>(false)),
+    pool(threads) {
+}
+
+AsyncLoader::~AsyncLoader() {
+    closing->store(true);
+}
+
+// queue order: by priority, then tasks of started loads before starting new ones
+static int parsePriority(int priority) {
+    return priority * 2;
+}
+
+static int continuePriority(int priority) {
+    return priority * 2 + 1;
+}
+
+std::unique_ptr<aseprite::DecoderContext> AsyncLoader::acquireContext() {
+    std::lock_guard<std::mutex> lock(contextsMutex);
+    if (idleContexts.empty()) {
+        return std::make_unique<aseprite::DecoderContext>();
+    }
+    auto context = std::move(idleContexts.back());
+    idleContexts.pop_back();
+    return context;
+}
+
+void AsyncLoader::releaseContext(std::unique_ptr<aseprite::DecoderContext> context) {
+    std::lock_guard<std::mutex> lock(contextsMutex);
+    idleContexts.push_back(std::move(context));
+}
+
+AsyncLoader::Request AsyncLoader::load(const std::string & path, const LoadOptions & options, int priority) {
+    auto job = std::make_shared<Job>();
+    job->path = path;
+    job->options = options;
+    job->options.memory = nullptr;
+    job->options.context = nullptr;
+    job->priority = priority;
+    job->cancelled = std::make_shared<std::atomic<bool>>(false);
+    job->closing = closing;
+
+    Request request;
+    request.result = job->promise.get_future();
+    request.cancelled = job->cancelled;
+    pool.submit([this, job] { parse(job); }, parsePriority(priority));
+    return request;
+}
+
+void AsyncLoader::parse(std::shared_ptr<Job> job) {
+    if (job->stopped()) {
+        finish(job, std::nullopt);
+        return;
+    }
+    try {
+        job->context = acquireContext();
+        job->options.context = job->context.get();
+        auto & ase = job->ase.emplace(makeReader(job->options));
+        ase.deferInflate = true;
+        if (!ase.read(job->path)) {
+            finish(job, std::nullopt);
+            return;
+        }
+
+        size_t batchSize = INFLATE_BATCH_SIZE;
+        for (auto & frame : ase.frames) {
+            for (auto & chunk : frame.chunks) {
+                if (chunk.type != aseprite::CEL_0x2005) {
+                    continue;
+                }
+                auto & cel = std::get<aseprite::CEL_CHUNK>(chunk.data);
+                if (cel.type != 2 || cel.skipped) {
+                    continue;
+                }
+                if (batchSize >= INFLATE_BATCH_SIZE) {
+                    job->batches.emplace_back();
+                    batchSize = 0;
+                }
+                job->batches.back().push_back(&cel);
+                batchSize += cel.pixels.size() * sizeof(aseprite::PIXEL_DATA);
+            }
+        }
+    } catch (...) {
+        finish(job, std::current_exception());
+        return;
+    }
+
+    if (job->batches.empty()) {
+        convert(job);
+        return;
+    }
+    job->remaining = job->batches.size();
+    for (size_t b = 0; b < job->batches.size(); b++) {
+        pool.submit([this, job, b] {
+            if (!job->stopped() && !job->failed) {
+                const auto & ase = *job->ase;
+                auto pixelFormat = ase.header.pixelFormat();
+                try {
+                    auto & context = aseprite::threadDecoderContext();
+                    for (auto * cel : job->batches[b]) {
+                        if (!cel->inflate(pixelFormat, *ase.decompressor, context)) {
+                            job->failed = true;
+                            break;
+                        }
+                    }
+                } catch (...) {
+                    if (!job->failed.exchange(true)) {
+                        job->error = std::current_exception();
+                    }
+                }
+            }
+            // the last batch converts, also after a failure so the result is always set
+            if (job->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                convert(job);
+            }
+        }, continuePriority(job->priority));
+    }
+}
+
+void AsyncLoader::convert(const std::shared_ptr<Job> & job) {
+    if (job->error) {
+        finish(job, job->error);
+        return;
+    }
+    if (job->stopped() || job->failed) {
+        finish(job, std::nullopt);
+        return;
+    }
+    try {
+        std::optional<Animation> animation;
+        {
+            aseprite::LoadStats::Scope scope(job->options.stats, aseprite::LoadStats::CONVERT);
+            animation = fromASEPRITE(*job->ase, job->options);
+        }
+        finish(job, std::move(animation));
+    } catch (...) {
+        finish(job, std::current_exception());
+    }
+}
+
+void AsyncLoader::finish(const std::shared_ptr<Job> & job, std::optional<Animation> && animation) {
+    release(job);
+    job->promise.set_value(std::move(animation));
+}
+
+void AsyncLoader::finish(const std::shared_ptr<Job> & job, std::exception_ptr exception) {
+    release(job);
+    job->promise.set_exception(exception);
+}
+
+// the parsed file is dropped and the context goes back to the loader before the result is set
+void AsyncLoader::release(const std::shared_ptr<Job> & job) {
+    job->ase.reset();
+    job->batches.clear();
+    if (job->context) {
+        job->options.context = nullptr;
+        releaseContext(std::move(job->context));
+    }
+}
+
+}
@@ -0,0 +1,94 @@
+/*
+ * Loading sprites in the background
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef ASYNC_LOADER_H
+#define ASYNC_LOADER_H
+
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "animation.h"
+#include "decoder_context.h"
+#include "thread_pool.h"
+
+namespace animation {
+
+/**
+ * Loads .aseprite files on its own threads. A load is split into tasks: reading and parsing
+ * the file, inflating its cels in batches (in parallel) and converting it to an Animation,
+ * so several loads progress at once and a large file uses all the threads.
+ *
+ * load() only queues the work, the caller is never blocked until it waits on the future.
+ */
+class AsyncLoader {
+public:
+    /**
+     * The animation, or nullopt when the file can't be read or the load was cancelled.
+     * Exceptions of any stage (like bad_alloc) are rethrown by result.get().
+     */
+    class Request {
+    public:
+        std::future<std::optional<Animation>> result;
+
+        /**
+         * Work not started yet is skipped, the result becomes nullopt soon.
+         */
+        void cancel() {
+            cancelled->store(true);
+        }
+
+    private:
+        friend class AsyncLoader;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    /**
+     * 0 threads -> one per hardware thread.
+     */
+    explicit AsyncLoader(unsigned threads = 0);
+
+    /**
+     * Loads still queued are cancelled, running tasks are waited for.
+     */
+    ~AsyncLoader();
+
+    /**
+     * Tasks of loads with higher priority run first (e.g. sprites on screen before the others),
+     * of equal priority loads already started are finished before new ones are started.
+     * Loads parse into the arena of a context owned by the loader, LoadOptions::memory and
+     * context are not used.
+     * LoadOptions::stats gets file read, parse and convert times, inflating isn't measured;
+     * don't share one LoadStats between loads running at once.
+     */
+    Request load(const std::string & path, const LoadOptions & options = LoadOptions(), int priority = 0);
+
+private:
+    struct Job;
+
+    std::shared_ptr<std::atomic<bool>> closing;
+    std::mutex contextsMutex;
+    std::vector<std::unique_ptr<aseprite::DecoderContext>> idleContexts; // warm arenas of finished loads
+    ThreadPool pool;
+
+    std::unique_ptr<aseprite::DecoderContext> acquireContext();
+    void releaseContext(std::unique_ptr<aseprite::DecoderContext> context);
+
+    void parse(std::shared_ptr<Job> job);
+    void convert(const std::shared_ptr<Job> & job);
+    void finish(const std::shared_ptr<Job> & job, std::optional<Animation> && animation);
+    void finish(const std::shared_ptr<Job> & job, std::exception_ptr exception);
+    void release(const std::shared_ptr<Job> & job);
+};
+
+}
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Collision masks
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+#include <cstdint>
+#include <algorithm>
+#include "collision_mask.h"
+#include "animation.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COLLISION_MASK_SSE2
+#endif
+
+namespace animation {
+
+// bit i set where pixels[i] != transparentIndex, count <= 64
+static uint64_t packIndexed(const uint8_t * pixels, uint32_t count, uint8_t transparentIndex) {
+    uint64_t word = 0;
+    uint32_t i = 0;
+#ifdef COLLISION_MASK_SSE2
+    const __m128i transparent = _mm_set1_epi8(static_cast<char>(transparentIndex));
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i));
+        uint32_t isTransparent = _mm_movemask_epi8(_mm_cmpeq_epi8(v, transparent));
+        word |= static_cast<uint64_t>(~isTransparent & 0xFFFF) << i;
+    }
+#endif
+    for (; i < count; i++) {
+        word |= static_cast<uint64_t>(pixels[i] != transparentIndex) << i;
+    }
+    return word;
+}
+
+// bit i set where alpha of 4 byte pixel i >= alphaThreshold, alpha is byte ALPHA of a pixel, count <= 64
+template <int ALPHA>
+static uint64_t packAlpha(const uint8_t * pixels, uint32_t count, uint8_t alphaThreshold) {
+    uint64_t word = 0;
+    uint32_t i = 0;
+#ifdef COLLISION_MASK_SSE2
+    const __m128i threshold = _mm_set1_epi8(static_cast<char>(alphaThreshold));
+    const __m128i lowByte = _mm_set1_epi32(0xFF);
+    for (; i + 16 <= count; i += 16) {
+        const __m128i * p = reinterpret_cast<const __m128i *>(pixels + 4 * i);
+        // move the alpha of 16 pixels into 16 bytes
+        __m128i a0 = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128(p), 8 * ALPHA), lowByte);
+        __m128i a1 = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128(p + 1), 8 * ALPHA), lowByte);
+        __m128i a2 = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128(p + 2), 8 * ALPHA), lowByte);
+        __m128i a3 = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128(p + 3), 8 * ALPHA), lowByte);
+        __m128i alpha = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+        // alpha >= threshold <=> max(alpha, threshold) == alpha
+        __m128i solid = _mm_cmpeq_epi8(_mm_max_epu8(alpha, threshold), alpha);
+        word |= static_cast<uint64_t>(_mm_movemask_epi8(solid)) << i;
+    }
+#endif
+    for (; i < count; i++) {
+        word |= static_cast<uint64_t>(pixels[4 * i + ALPHA] >= alphaThreshold) << i;
+    }
+    return word;
+}
+
+template <int ALPHA>
+static CollisionMask fromAlpha(uint16_t width, uint16_t height, const uint8_t * pixels, uint8_t alphaThreshold) {
+    CollisionMask mask(width, height);
+    for (uint16_t y = 0; y < height; y++) {
+        const uint8_t * row = pixels + 4 * static_cast<size_t>(y) * width;
+        uint64_t * words = mask.row(y);
+        for (uint32_t w = 0; w < mask.wordsPerRow; w++) {
+            uint32_t x = w * 64;
+            words[w] = packAlpha<ALPHA>(row + 4 * x, std::min<uint32_t>(64, width - x), alphaThreshold);
+        }
+    }
+    return mask;
+}
+
+CollisionMask CollisionMask::fromIndexed(const Image & image, uint8_t transparentIndex) {
+    CollisionMask mask(image.width, image.height);
+    for (uint16_t y = 0; y < image.height; y++) {
+        const uint8_t * pixels = image.pixels.data() + static_cast<size_t>(y) * image.width;
+        uint64_t * words = mask.row(y);
+        for (uint32_t w = 0; w < mask.wordsPerRow; w++) {
+            uint32_t x = w * 64;
+            words[w] = packIndexed(pixels + x, std::min<uint32_t>(64, image.width - x), transparentIndex);
+        }
+    }
+    return mask;
+}
+
+CollisionMask CollisionMask::fromRGBA(uint16_t width, uint16_t height, const uint8_t * rgba, uint8_t alphaThreshold) {
+    return fromAlpha<3>(width, height, rgba, alphaThreshold);
+}
+
+CollisionMask CollisionMask::fromGrayscale(uint16_t width, uint16_t height, const uint8_t * pixels, uint8_t alphaThreshold) {
+    return fromAlpha<1>(width, height, pixels, alphaThreshold);
+}
+
+// 64 bits of a mask row starting at bit position
+static uint64_t bitsAt(const uint64_t * row, uint32_t words, uint32_t position) {
+    uint32_t w = position / 64;
+    uint32_t shift = position % 64;
+    uint64_t result = row[w] >> shift;
+    if (shift && w + 1 < words) {
+        result |= row[w + 1] << (64 - shift);
+    }
+    return result;
+}
+
+bool overlaps(const CollisionMask & a, int32_t ax, int32_t ay,
+              const CollisionMask & b, int32_t bx, int32_t by) {
+    const int32_t left = std::max(ax, bx);
+    const int32_t right = std::min(ax + a.width, bx + b.width);
+    const int32_t top = std::max(ay, by);
+    const int32_t bottom = std::min(ay + a.height, by + b.height);
+    if (left >= right || top >= bottom) {
+        return false;
+    }
+    const uint32_t width = right - left;
+    const uint32_t aStart = left - ax;
+    const uint32_t bStart = left - bx;
+    for (int32_t y = top; y < bottom; y++) {
+        const uint64_t * aRow = a.row(y - ay);
+        const uint64_t * bRow = b.row(y - by);
+        for (uint32_t x = 0; x < width; x += 64) {
+            uint64_t common = bitsAt(aRow, a.wordsPerRow, aStart + x)
+                            & bitsAt(bRow, b.wordsPerRow, bStart + x);
+            if (width - x < 64) {
+                common &= (uint64_t(1) << (width - x)) - 1;
+            }
+            if (common) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+}
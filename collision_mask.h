@@ -0,0 +1,79 @@
+/*
+ * Collision masks
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef COLLISION_MASK_H
+#define COLLISION_MASK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace animation {
+
+class Image;
+
+/**
+ * Silhouette of an image, one bit per pixel.
+ * Rows are padded to whole 64-bit words, pixel x of a row is bit x % 64 of word x / 64.
+ */
+class CollisionMask {
+public:
+    uint16_t width = 0;
+    uint16_t height = 0;
+    uint32_t wordsPerRow = 0;
+    std::vector<uint64_t> bits;
+
+    CollisionMask() = default;
+
+    CollisionMask(uint16_t width, uint16_t height) :
+        width(width),
+        height(height),
+        wordsPerRow((width + 63) / 64),
+        bits(static_cast<size_t>(wordsPerRow) * height) {
+    }
+
+    const uint64_t * row(uint16_t y) const {
+        return bits.data() + static_cast<size_t>(y) * wordsPerRow;
+    }
+
+    uint64_t * row(uint16_t y) {
+        return bits.data() + static_cast<size_t>(y) * wordsPerRow;
+    }
+
+    bool test(int32_t x, int32_t y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) {
+            return false;
+        }
+        return (row(y)[x / 64] >> (x % 64)) & 1;
+    }
+
+    /**
+     * Solid where the pixel is not transparentIndex.
+     */
+    static CollisionMask fromIndexed(const Image & image, uint8_t transparentIndex);
+
+    /**
+     * Solid where alpha >= alphaThreshold, rgba holds width * height RGBA quadruplets.
+     */
+    static CollisionMask fromRGBA(uint16_t width, uint16_t height, const uint8_t * rgba, uint8_t alphaThreshold);
+
+    /**
+     * Solid where alpha >= alphaThreshold, pixels holds width * height 4 byte pixels with
+     * the gray value and the alpha in the first two bytes (aseprite::PIXEL_DATA).
+     */
+    static CollisionMask fromGrayscale(uint16_t width, uint16_t height, const uint8_t * pixels, uint8_t alphaThreshold);
+};
+
+/**
+ * Tests whether two masks placed at given positions have a common solid pixel.
+ * For cels the position is the sprite position plus Cel::x, Cel::y.
+ */
+bool overlaps(const CollisionMask & a, int32_t ax, int32_t ay,
+              const CollisionMask & b, int32_t bx, int32_t by);
+
+}
+#endif
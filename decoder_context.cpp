@@ -0,0 +1,65 @@
+/*
+ * Scratch memory of the aseprite loader
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+#include "decoder_context.h"
+
+namespace aseprite {
+
+void * DecoderContext::Upstream::do_allocate(size_t bytes, size_t alignment) {
+    allocated += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void DecoderContext::Upstream::do_deallocate(void * p, size_t bytes, size_t alignment) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool DecoderContext::Upstream::do_is_equal(const std::pmr::memory_resource & other) const noexcept {
+    return this == &other;
+}
+
+DecoderContext::DecoderContext() :
+    fileBuffer(new char[FILE_BUFFER_SIZE]) {
+    // the stream keeps a buffer given before opening, it doesn't allocate one for every file
+    file.rdbuf()->pubsetbuf(fileBuffer.get(), FILE_BUFFER_SIZE);
+}
+
+std::pmr::memory_resource * DecoderContext::resetArena() {
+    arena.reset(); // gives the overflow back to the heap
+    if (upstream.allocated > 0) {
+        blockSize += upstream.allocated;
+        block.reset();
+        block.reset(new std::byte[blockSize]);
+        upstream.allocated = 0;
+    }
+    if (block) {
+        arena.emplace(block.get(), blockSize, &upstream);
+    } else {
+        arena.emplace(&upstream);
+    }
+    return &*arena;
+}
+
+void DecoderContext::release() {
+    arena.reset();
+    block.reset();
+    blockSize = 0;
+    upstream.allocated = 0;
+    std::vector<uint8_t>().swap(source);
+    std::vector<uint8_t>().swap(uncompressed);
+}
+
+DecoderContext & threadDecoderContext() {
+    static thread_local DecoderContext context;
+    return context;
+}
+
+}
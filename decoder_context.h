@@ -0,0 +1,82 @@
+/*
+ * Scratch memory of the aseprite loader
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef DECODER_CONTEXT_H
+#define DECODER_CONTEXT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+namespace aseprite {
+
+/**
+ * Buffers reused from one load to the next: the file stream and its buffer, compressed and
+ * inflated cel data and an arena for the parsed chunks (strings, tags, pixels, ...).
+ * Once it has grown to the largest file, reading performs no heap allocations.
+ *
+ * Not thread safe, give each worker its own context or use threadDecoderContext().
+ */
+class DecoderContext {
+public:
+    std::ifstream file;
+    std::vector<uint8_t> source;       // compressed cel data read whole
+    std::vector<uint8_t> uncompressed; // inflated indexed and grayscale cels
+
+    DecoderContext();
+
+    DecoderContext(const DecoderContext &) = delete;
+    DecoderContext & operator =(const DecoderContext &) = delete;
+
+    /**
+     * Starts a new load: everything allocated from the arena since the last call is released
+     * and the arena grows to fit what the last load took. Data of an ASEPRITE read into
+     * the arena is valid until the next call.
+     */
+    std::pmr::memory_resource * resetArena();
+
+    size_t arenaCapacity() const {
+        return blockSize;
+    }
+
+    /**
+     * Frees the memory held by the context, the buffers grow again when it is used.
+     */
+    void release();
+
+private:
+    // counts what the arena has to take from the heap when its block is too small
+    class Upstream : public std::pmr::memory_resource {
+    public:
+        size_t allocated = 0;
+    private:
+        void * do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void * p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override;
+    };
+
+    static constexpr size_t FILE_BUFFER_SIZE = 16 * 1024;
+
+    std::unique_ptr<char[]> fileBuffer;
+    Upstream upstream;
+    std::unique_ptr<std::byte[]> block;
+    size_t blockSize = 0;
+    std::optional<std::pmr::monotonic_buffer_resource> arena;
+};
+
+/**
+ * Context of the calling thread, used by the loader when none is given.
+ */
+DecoderContext & threadDecoderContext();
+
+}
+
+#endif
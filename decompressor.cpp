@@ -0,0 +1,183 @@
+/*
+ * Decompression backends for cel data
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+#include <cstdint>
+#include <algorithm>
+#include <istream>
+#include <vector>
+#include "tinf/tinf.h"
+#include "decompressor.h"
+
+#ifdef ASEPRITE_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef ASEPRITE_WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+namespace aseprite {
+
+constexpr uint32_t ZLIB_HEADER_SIZE = 2;
+constexpr uint32_t ZLIB_ADLER_SIZE = 4;
+// input is read in pieces of this size by the streaming backends
+constexpr uint32_t READ_BUFFER_SIZE = 16 * 1024;
+
+bool Decompressor::uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                              std::istream & source, uint32_t sourceLen) const {
+    static thread_local std::vector<uint8_t> buffer;
+    destLen = 0;
+    buffer.resize(sourceLen);
+    if (!source.read((char *) buffer.data(), sourceLen)) {
+        return false;
+    }
+    return uncompress(dest, destCapacity, destLen, buffer.data(), sourceLen);
+}
+
+// skips the rest of a stream which ended before sourceLen bytes were read
+static bool skip(std::istream & source, uint32_t length) {
+    return length == 0 || bool(source.ignore(length));
+}
+
+TinfDecompressor::TinfDecompressor() {
+    static const bool initialized = (tinf_init(), true);
+    (void) initialized;
+}
+
+const char * TinfDecompressor::name() const {
+    return "tinf";
+}
+
+bool TinfDecompressor::uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                                  const uint8_t * source, uint32_t sourceLen) const {
+    destLen = 0;
+    if (sourceLen < ZLIB_HEADER_SIZE + ZLIB_ADLER_SIZE
+        || (source[0] & 0x0F) != 8 /* deflate */
+        || (source[0] * 256 + source[1]) % 31 != 0) {
+        return false;
+    }
+    unsigned int written;
+    int outcome = tinf_uncompress_bounded(dest, destCapacity, &written,
+        source + ZLIB_HEADER_SIZE, sourceLen - ZLIB_HEADER_SIZE - ZLIB_ADLER_SIZE);
+    destLen = written;
+    return outcome == TINF_OK;
+}
+
+bool TinfDecompressor::uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                                  std::istream & source, uint32_t sourceLen) const {
+    uint8_t buffer[READ_BUFFER_SIZE];
+    TINF_STREAM stream;
+    tinf_stream_init(&stream, dest, destCapacity, 1);
+    int outcome = TINF_NEED_INPUT;
+    while (outcome == TINF_NEED_INPUT && sourceLen > 0) {
+        uint32_t length = std::min(sourceLen, READ_BUFFER_SIZE);
+        if (!source.read((char *) buffer, length)) {
+            destLen = stream.destLen;
+            return false;
+        }
+        sourceLen -= length;
+        unsigned int consumed;
+        outcome = tinf_stream_inflate(&stream, buffer, length, &consumed);
+    }
+    destLen = stream.destLen;
+    return outcome == TINF_OK && skip(source, sourceLen);
+}
+
+#ifdef ASEPRITE_WITH_ZLIB
+const char * ZlibDecompressor::name() const {
+    return "zlib";
+}
+
+// inflate state of the calling thread, reset for every stream instead of allocated
+static z_stream * threadStream() {
+    struct Stream {
+        z_stream stream{};
+        bool initialized = inflateInit(&stream) == Z_OK;
+        ~Stream() {
+            if (initialized) {
+                inflateEnd(&stream);
+            }
+        }
+    };
+    static thread_local Stream state;
+    return state.initialized && inflateReset(&state.stream) == Z_OK ? &state.stream : nullptr;
+}
+
+bool ZlibDecompressor::uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                                  const uint8_t * source, uint32_t sourceLen) const {
+    z_stream * stream = threadStream();
+    destLen = 0;
+    if (!stream) {
+        return false;
+    }
+    stream->next_in = const_cast<uint8_t *>(source);
+    stream->avail_in = sourceLen;
+    stream->next_out = dest;
+    stream->avail_out = destCapacity;
+    int outcome = inflate(stream, Z_FINISH);
+    destLen = stream->total_out;
+    return outcome == Z_STREAM_END;
+}
+
+bool ZlibDecompressor::uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                                  std::istream & source, uint32_t sourceLen) const {
+    uint8_t buffer[READ_BUFFER_SIZE];
+    z_stream * stream = threadStream();
+    destLen = 0;
+    if (!stream) {
+        return false;
+    }
+    stream->next_out = dest;
+    stream->avail_out = destCapacity;
+    int outcome = Z_OK;
+    while (outcome == Z_OK && sourceLen > 0) {
+        uint32_t length = std::min(sourceLen, READ_BUFFER_SIZE);
+        if (!source.read((char *) buffer, length)) {
+            break;
+        }
+        sourceLen -= length;
+        stream->next_in = buffer;
+        stream->avail_in = length;
+        outcome = inflate(stream, Z_NO_FLUSH);
+    }
+    destLen = stream->total_out;
+    return outcome == Z_STREAM_END && skip(source, sourceLen);
+}
+#endif
+
+#ifdef ASEPRITE_WITH_LIBDEFLATE
+const char * LibdeflateDecompressor::name() const {
+    return "libdeflate";
+}
+
+bool LibdeflateDecompressor::uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                                        const uint8_t * source, uint32_t sourceLen) const {
+    // libdeflate decompressors can't be shared between threads
+    struct Handle {
+        libdeflate_decompressor * decompressor = libdeflate_alloc_decompressor();
+        ~Handle() {
+            libdeflate_free_decompressor(decompressor);
+        }
+    };
+    static thread_local Handle handle;
+    destLen = 0;
+    if (!handle.decompressor) {
+        return false;
+    }
+    size_t written = 0;
+    auto outcome = libdeflate_zlib_decompress(handle.decompressor, source, sourceLen,
+        dest, destCapacity, &written);
+    destLen = written;
+    return outcome == LIBDEFLATE_SUCCESS;
+}
+#endif
+
+const Decompressor & defaultDecompressor() {
+    static const TinfDecompressor tinf;
+    return tinf;
+}
+
+}
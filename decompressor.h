@@ -0,0 +1,90 @@
+/*
+ * Decompression backends for cel data
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef DECOMPRESSOR_H
+#define DECOMPRESSOR_H
+
+#include <cstdint>
+#include <istream>
+
+namespace aseprite {
+
+/**
+ * Inflates the zlib streams (2 byte header, deflate data, adler32) of compressed cels.
+ *
+ * The bundled tinf is always available, define ASEPRITE_WITH_ZLIB (link -lz)
+ * or ASEPRITE_WITH_LIBDEFLATE (link -ldeflate) to build the other backends.
+ * Implementations must be usable from several threads at once.
+ */
+class Decompressor {
+public:
+    virtual ~Decompressor() = default;
+
+    virtual const char * name() const = 0;
+
+    /**
+     * Writes at most destCapacity bytes to dest, destLen receives the number written.
+     * Returns false for corrupt or truncated streams and when the output doesn't fit.
+     */
+    virtual bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                            const uint8_t * source, uint32_t sourceLen) const = 0;
+
+    /**
+     * Same as above with the stream read from source, exactly sourceLen bytes are consumed
+     * unless reading fails. The default reads all of it into a scratch buffer first,
+     * backends able to resume decoding override it to work with a small read buffer.
+     */
+    virtual bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                            std::istream & source, uint32_t sourceLen) const;
+};
+
+class TinfDecompressor : public Decompressor {
+public:
+    TinfDecompressor();
+
+    const char * name() const override;
+
+    bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                    const uint8_t * source, uint32_t sourceLen) const override;
+
+    bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                    std::istream & source, uint32_t sourceLen) const override;
+};
+
+#ifdef ASEPRITE_WITH_ZLIB
+class ZlibDecompressor : public Decompressor {
+public:
+    const char * name() const override;
+
+    bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                    const uint8_t * source, uint32_t sourceLen) const override;
+
+    bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                    std::istream & source, uint32_t sourceLen) const override;
+};
+#endif
+
+#ifdef ASEPRITE_WITH_LIBDEFLATE
+class LibdeflateDecompressor : public Decompressor {
+public:
+    using Decompressor::uncompress;
+
+    const char * name() const override;
+
+    bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                    const uint8_t * source, uint32_t sourceLen) const override;
+};
+#endif
+
+/**
+ * The bundled tinf backend.
+ */
+const Decompressor & defaultDecompressor();
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * Flat open addressing hash map
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef FLAT_HASH_MAP_H
+#define FLAT_HASH_MAP_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace animation {
+
+/**
+ * Hash map with linear probing over one contiguous array of slots.
+ * Entries can't be erased, which is all the lookups built at load time need.
+ */
+template <typename KEY, typename VALUE, typename HASH = std::hash<KEY>>
+class FlatHashMap {
+    struct Slot {
+        KEY key{};
+        VALUE value{};
+        bool used = false;
+    };
+
+    std::vector<Slot> slots; // size is zero or a power of two
+    size_t count = 0;
+    size_t mask = 0;
+    HASH hash;
+
+    size_t slotOf(const KEY & key) const {
+        // fibonacci hashing spreads identity hashes of small integers
+        return (static_cast<uint64_t>(hash(key)) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> old(capacity);
+        old.swap(slots);
+        mask = capacity - 1;
+        for (auto & slot : old) {
+            if (slot.used) {
+                size_t i = slotOf(slot.key);
+                while (slots[i].used) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = std::move(slot);
+            }
+        }
+    }
+
+public:
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    /**
+     * Bytes of the slots, not counting memory owned by the keys and values.
+     */
+    size_t memoryFootprint() const {
+        return slots.capacity() * sizeof(Slot);
+    }
+
+    void clear() {
+        slots.clear();
+        count = 0;
+        mask = 0;
+    }
+
+    void reserve(size_t entries) {
+        size_t capacity = 8;
+        while (capacity < entries * 2) { // keep load factor at most 0.5
+            capacity *= 2;
+        }
+        if (capacity > slots.size()) {
+            rehash(capacity);
+        }
+    }
+
+    const VALUE * find(const KEY & key) const {
+        if (count == 0) {
+            return nullptr;
+        }
+        for (size_t i = slotOf(key); slots[i].used; i = (i + 1) & mask) {
+            if (slots[i].key == key) {
+                return &slots[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    VALUE * find(const KEY & key) {
+        return const_cast<VALUE *>(static_cast<const FlatHashMap &>(*this).find(key));
+    }
+
+    bool contains(const KEY & key) const {
+        return find(key) != nullptr;
+    }
+
+    VALUE & operator [](const KEY & key) {
+        if (VALUE * value = find(key)) {
+            return *value;
+        }
+        reserve(count + 1);
+        size_t i = slotOf(key);
+        while (slots[i].used) {
+            i = (i + 1) & mask;
+        }
+        slots[i].key = key;
+        slots[i].used = true;
+        count++;
+        return slots[i].value;
+    }
+
+    template <typename FUNCTION>
+    void forEach(FUNCTION function) const {
+        for (const auto & slot : slots) {
+            if (slot.used) {
+                function(slot.key, slot.value);
+            }
+        }
+    }
+};
+
+}
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Expanding indexed images to 32 bit pixels
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+#include <cstdint>
+#include <cstring>
+#include "animation.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#define IMAGE_EXPAND_AVX2
+#endif
+
+namespace animation {
+
+PaletteLookup::PaletteLookup(const Palette & palette, PixelLayout layout, uint8_t opacity, uint8_t transparentIndex) {
+    const bool bgra = layout == PixelLayout::BGRA8 || layout == PixelLayout::BGRA8_PREMULTIPLIED;
+    const bool premultiplied = layout == PixelLayout::RGBA8_PREMULTIPLIED || layout == PixelLayout::BGRA8_PREMULTIPLIED;
+    for (size_t i = 0; i < pixels.size(); i++) {
+        Color c = palette.colors[i];
+        c.a = i == transparentIndex ? 0 : multiplyOpacity(c.a, opacity);
+        if (c.a == 0) {
+            c = Color{0, 0, 0, 0};
+        } else if (premultiplied) {
+            c.r = multiplyOpacity(c.r, c.a);
+            c.g = multiplyOpacity(c.g, c.a);
+            c.b = multiplyOpacity(c.b, c.a);
+        }
+        const uint8_t bytes[4] = {bgra ? c.b : c.r, c.g, bgra ? c.r : c.b, c.a};
+        std::memcpy(&pixels[i], bytes, sizeof(bytes));
+    }
+}
+
+bool Image::expand(const PaletteLookup & lookup, void * destination, size_t pitch) const {
+    assert(hasPixels());
+    if (!hasPixels()) {
+        return false;
+    }
+    const uint32_t * table = lookup.pixels.data();
+    for (uint16_t y = 0; y < height; y++) {
+        const uint8_t * source = pixels.data() + static_cast<size_t>(y) * width;
+        uint8_t * row = static_cast<uint8_t *>(destination) + y * pitch;
+        uint32_t x = 0;
+#ifdef IMAGE_EXPAND_AVX2
+        for (; x + 8 <= width; x += 8) {
+            __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(source + x)));
+            __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int *>(table), indices, 4);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(row + 4 * x), colors);
+        }
+#endif
+        for (; x < width; x++) {
+            std::memcpy(row + 4 * x, &table[source[x]], 4); // the destination may be unaligned
+        }
+    }
+    return true;
+}
+
+}
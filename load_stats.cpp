@@ -0,0 +1,102 @@
+/*
+ * Load instrumentation
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#include <cstdint>
+#include <fstream>
+#include "load_stats.h"
+
+namespace aseprite {
+
+const char * LoadStats::phaseName(PHASE phase) {
+    switch (phase) {
+    case FILE_READ:
+        return "file read";
+    case CHUNK_PARSE:
+        return "chunk parse";
+    case INFLATE:
+        return "inflate";
+    case PIXEL_REPACK:
+        return "pixel repack";
+    case CONVERT:
+        return "convert";
+    default:
+        return "?";
+    }
+}
+
+double LoadStats::totalSeconds() const {
+    double total = 0;
+    for (double s : seconds) {
+        total += s;
+    }
+    return total;
+}
+
+void LoadStats::enter(PHASE phase, Scope & scope) {
+    auto now = Clock::now();
+    if (depth == 0) {
+        if (!started) {
+            origin = now;
+            started = true;
+        }
+        if (allocationCounter) {
+            allocationsAtStart = allocationCounter();
+        }
+    } else {
+        seconds[current] += std::chrono::duration<double>(now - since).count();
+    }
+    scope.previous = current;
+    scope.start = now;
+    current = phase;
+    since = now;
+    depth++;
+}
+
+void LoadStats::leave(Scope & scope) {
+    auto now = Clock::now();
+    seconds[current] += std::chrono::duration<double>(now - since).count();
+    if (trace) {
+        events.push_back(Event{
+            current,
+            std::chrono::duration<double>(scope.start - origin).count(),
+            std::chrono::duration<double>(now - scope.start).count()});
+    }
+    current = scope.previous;
+    since = now;
+    depth--;
+    if (depth == 0 && allocationCounter) {
+        allocations += allocationCounter() - allocationsAtStart;
+    }
+}
+
+void LoadStats::writeChromeTrace(std::ostream & s) const {
+    s << "{\"traceEvents\":[";
+    const char * separator = "\n";
+    for (const auto & event : events) {
+        s << separator
+          << "{\"name\":\"" << phaseName(event.phase) << "\",\"cat\":\"load\",\"ph\":\"X\""
+          << ",\"ts\":" << event.start * 1e6
+          << ",\"dur\":" << event.duration * 1e6
+          << ",\"pid\":1,\"tid\":1}";
+        separator = ",\n";
+    }
+    s << "\n],\"otherData\":{"
+      << "\"bytesRead\":" << bytesRead
+      << ",\"bytesDecompressed\":" << bytesDecompressed
+      << ",\"cels\":" << cels
+      << ",\"allocations\":" << allocations
+      << "}}\n";
+}
+
+bool LoadStats::writeChromeTrace(const std::string & path) const {
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    writeChromeTrace(file);
+    file.close();
+    return !file.fail();
+}
+
+}
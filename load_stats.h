@@ -0,0 +1,117 @@
+/*
+ * Load instrumentation
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef LOAD_STATS_H
+#define LOAD_STATS_H
+
+#include <cstdint>
+#include <chrono>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace aseprite {
+
+/**
+ * Statistics of one or more loads, filled when passed to the loader (LoadOptions::stats,
+ * ASEPRITE constructor), nothing is measured when the pointer is nullptr.
+ *
+ * Phase times are exclusive, time of a nested phase is not counted in the enclosing one.
+ * While instrumented, compressed cels are read whole before they are inflated,
+ * so reading and inflating are timed apart.
+ */
+class LoadStats {
+public:
+    enum PHASE {
+        FILE_READ,    // opening, header, reading cel data
+        CHUNK_PARSE,  // chunk headers and contents other than pixels
+        INFLATE,
+        PIXEL_REPACK, // inflated bytes to PIXEL_DATA
+        CONVERT,      // fromASEPRITE
+        PHASE_COUNT
+    };
+
+    static const char * phaseName(PHASE phase);
+
+    struct Event {
+        PHASE phase;
+        double start; // seconds since the first measured scope
+        double duration;
+    };
+
+    double seconds[PHASE_COUNT] = {};
+    uint64_t bytesRead = 0;
+    uint64_t bytesDecompressed = 0;
+    uint64_t cels = 0; // compressed cels inflated
+    std::map<uint16_t, uint32_t> chunks; // chunk type -> count
+
+    /**
+     * Allocations are counted when set, typically to a counter kept by a replaced operator new.
+     */
+    uint64_t (*allocationCounter)() = nullptr;
+    uint64_t allocations = 0;
+
+    /**
+     * Record an event for every scope, for writeChromeTrace.
+     */
+    bool trace = false;
+    std::vector<Event> events;
+
+    double totalSeconds() const;
+
+    /**
+     * Chrome trace event format JSON, open it in chrome://tracing or Perfetto.
+     */
+    void writeChromeTrace(std::ostream & s) const;
+
+    bool writeChromeTrace(const std::string & path) const;
+
+    /**
+     * Times the enclosing block as given phase, does nothing for nullptr stats.
+     */
+    class Scope {
+        friend class LoadStats;
+        LoadStats * stats;
+        PHASE previous;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        Scope(LoadStats * stats, PHASE phase) :
+            stats(stats) {
+            if (stats) {
+                stats->enter(phase, *this);
+            }
+        }
+
+        Scope(const Scope &) = delete;
+        Scope & operator =(const Scope &) = delete;
+
+        ~Scope() {
+            if (stats) {
+                stats->leave(*this);
+            }
+        }
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    uint32_t depth = 0;
+    PHASE current = FILE_READ;
+    Clock::time_point since;
+    Clock::time_point origin;
+    bool started = false;
+    uint64_t allocationsAtStart = 0;
+
+    void enter(PHASE phase, Scope & scope);
+    void leave(Scope & scope);
+};
+
+}
+
+#endif
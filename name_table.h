@@ -0,0 +1,111 @@
+/*
+ * Interned names
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef NAME_TABLE_H
+#define NAME_TABLE_H
+
+#include <cstdint>
+#include <cassert>
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <vector>
+
+namespace animation {
+
+using NameHandle = uint32_t;
+
+constexpr NameHandle NO_NAME = UINT32_MAX;
+
+/**
+ * Interns strings, handing out handles which are dense indices
+ * that stay valid for the lifetime of the table.
+ */
+class NameTable {
+    struct Slot {
+        size_t hash = 0;
+        NameHandle handle = NO_NAME; // NO_NAME -> empty slot
+    };
+
+    std::vector<std::string> names;
+    std::vector<Slot> slots; // open addressing, size is zero or a power of two
+
+    size_t slotOf(size_t hash) const {
+        return hash & (slots.size() - 1);
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.empty() ? 16 : slots.size() * 2);
+        old.swap(slots);
+        for (const auto & slot : old) {
+            if (slot.handle != NO_NAME) {
+                size_t i = slotOf(slot.hash);
+                while (slots[i].handle != NO_NAME) {
+                    i = slotOf(i + 1);
+                }
+                slots[i] = slot;
+            }
+        }
+    }
+
+public:
+    size_t size() const {
+        return names.size();
+    }
+
+    /**
+     * Bytes of the names and the slots.
+     */
+    size_t memoryFootprint() const {
+        size_t bytes = names.capacity() * sizeof(std::string) + slots.capacity() * sizeof(Slot);
+        for (const auto & name : names) {
+            bytes += name.capacity();
+        }
+        return bytes;
+    }
+
+    NameHandle find(std::string_view name) const {
+        if (slots.empty()) {
+            return NO_NAME;
+        }
+        const size_t hash = std::hash<std::string_view>()(name);
+        for (size_t i = slotOf(hash); slots[i].handle != NO_NAME; i = slotOf(i + 1)) {
+            if (slots[i].hash == hash && names[slots[i].handle] == name) {
+                return slots[i].handle;
+            }
+        }
+        return NO_NAME;
+    }
+
+    NameHandle intern(std::string_view name) {
+        NameHandle handle = find(name);
+        if (handle != NO_NAME) {
+            return handle;
+        }
+        if ((names.size() + 1) * 2 > slots.size()) { // keep load factor at most 0.5
+            grow();
+        }
+        const size_t hash = std::hash<std::string_view>()(name);
+        size_t i = slotOf(hash);
+        while (slots[i].handle != NO_NAME) {
+            i = slotOf(i + 1);
+        }
+        handle = names.size();
+        names.emplace_back(name);
+        slots[i] = Slot{hash, handle};
+        return handle;
+    }
+
+    const std::string & name(NameHandle handle) const {
+        assert(handle < names.size());
+        return names[handle];
+    }
+};
+
+}
+#endif
@@ -0,0 +1,83 @@
+/*
+ * Run-length encoded images
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+#include <cstdint>
+#include <algorithm>
+#include "rle_image.h"
+#include "animation.h"
+
+namespace animation {
+
+RleImage RleImage::encode(const Image & image, uint8_t transparentIndex) {
+    RleImage rle;
+    rle.width = image.width;
+    rle.height = image.height;
+    rle.rowStart.assign(size_t(image.height) + 1, 0);
+    if (image.pixels.size() != size_t(image.width) * image.height) {
+        return rle;
+    }
+    for (uint16_t y = 0; y < image.height; y++) {
+        rle.rowStart[y] = rle.runs.size();
+        const uint8_t * row = image.pixels.data() + size_t(y) * image.width;
+        uint32_t x = 0;
+        while (x < image.width) {
+            uint32_t end = x + 1;
+            while (end < image.width && row[end] == row[x]) {
+                end++;
+            }
+            if (row[x] != transparentIndex) {
+                rle.runs.push_back(Run{uint16_t(x), uint16_t(end - x), row[x]});
+            }
+            x = end;
+        }
+    }
+    rle.rowStart[image.height] = rle.runs.size();
+    return rle;
+}
+
+Image RleImage::decode(uint8_t transparentIndex) const {
+    std::vector<uint8_t> pixels(size_t(width) * height, transparentIndex);
+    for (uint16_t y = 0; y < height; y++) {
+        uint8_t * row = pixels.data() + size_t(y) * width;
+        for (uint32_t r = rowStart[y]; r < rowStart[y + 1]; r++) {
+            std::fill_n(row + runs[r].x, runs[r].length, runs[r].index);
+        }
+    }
+    return Image(width, height, std::move(pixels));
+}
+
+size_t RleImage::opaquePixels() const {
+    size_t count = 0;
+    for (const auto & run : runs) {
+        count += run.length;
+    }
+    return count;
+}
+
+void RleImage::blit(const PaletteLookup & lookup, void * destination, size_t pitch,
+                    int32_t destinationWidth, int32_t destinationHeight, int32_t x, int32_t y) const {
+    const int32_t top = std::max(0, -y);
+    const int32_t bottom = std::min<int32_t>(height, destinationHeight - y);
+    const int32_t left = std::max(0, -x); // clip rectangle in image coordinates
+    const int32_t right = std::min<int32_t>(width, destinationWidth - x);
+    if (left >= right) {
+        return;
+    }
+    for (int32_t row = top; row < bottom; row++) {
+        // columns are offset from the start of the row, x alone may be negative
+        uint32_t * target = reinterpret_cast<uint32_t *>(static_cast<uint8_t *>(destination) + size_t(y + row) * pitch);
+        for (uint32_t r = rowStart[row]; r < rowStart[row + 1]; r++) {
+            const Run & run = runs[r];
+            const int32_t first = std::max<int32_t>(run.x, left);
+            const int32_t end = std::min<int32_t>(run.x + run.length, right);
+            if (first < end) {
+                std::fill(target + (x + first), target + (x + end), lookup.pixels[run.index]);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,58 @@
+/*
+ * Run-length encoded images
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef RLE_IMAGE_H
+#define RLE_IMAGE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace animation {
+
+class Image;
+class PaletteLookup;
+
+/**
+ * Indexed image stored as runs of equal pixels, transparent runs are left out.
+ * Drawing it costs per run and opaque pixel, not per pixel of its area.
+ */
+class RleImage {
+public:
+    class Run {
+    public:
+        uint16_t x;
+        uint16_t length;
+        uint8_t index;
+    };
+
+    uint16_t width = 0;
+    uint16_t height = 0;
+    std::vector<Run> runs; // opaque runs, row by row, left to right
+    std::vector<uint32_t> rowStart; // row -> first run of the row, height + 1 entries
+
+    RleImage() = default;
+
+    /**
+     * An image without all its pixels (e.g. skipped by a reload) gives an empty one of its size.
+     */
+    static RleImage encode(const Image & image, uint8_t transparentIndex);
+
+    Image decode(uint8_t transparentIndex) const;
+
+    size_t opaquePixels() const;
+
+    /**
+     * Writes the opaque pixels at x, y of a destination of 32 bit pixels, rows pitch bytes apart
+     * and 4 byte aligned, clipped to destinationWidth x destinationHeight. Pixels are replaced, not blended.
+     */
+    void blit(const PaletteLookup & lookup, void * destination, size_t pitch,
+              int32_t destinationWidth, int32_t destinationHeight, int32_t x, int32_t y) const;
+};
+
+}
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Drawing many sprites into one image
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+#include "sprite_batch.h"
+
+namespace animation {
+
+SpriteBatchRenderer::SpriteBatchRenderer(ThreadPool & pool, uint32_t tileSize) :
+    pool(pool),
+    tileSize(std::max(1u, tileSize)) {
+}
+
+// premultiplied source over destination, the source scaled by opacity first
+static inline void blend(uint8_t * destination, const uint8_t * source, uint8_t opacity) {
+    uint8_t s[4] = {source[0], source[1], source[2], source[3]};
+    if (opacity != 255) {
+        for (int c = 0; c < 4; c++) {
+            s[c] = multiplyOpacity(s[c], opacity);
+        }
+    }
+    if (s[3] == 255) {
+        std::copy(s, s + 4, destination);
+    } else if (s[3] != 0) {
+        const uint8_t inverse = 255 - s[3];
+        for (int c = 0; c < 4; c++) {
+            destination[c] = s[c] + multiplyOpacity(destination[c], inverse);
+        }
+    }
+}
+
+void SpriteBatchRenderer::collect(const std::vector<SpriteDraw> & draws, uint32_t width, uint32_t height) {
+    sorted.resize(draws.size());
+    for (uint32_t i = 0; i < sorted.size(); i++) {
+        sorted[i] = i;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [&draws](uint32_t a, uint32_t b) { return draws[a].order < draws[b].order; });
+
+    items.clear();
+    lookups.clear();
+    lookupIndex.clear();
+    previousViews.swap(defaultViews);
+    std::swap(previousViewIndex, defaultViewIndex);
+    defaultViews.clear();
+    defaultViewIndex.clear();
+    for (uint32_t d : sorted) {
+        const SpriteDraw & draw = draws[d];
+        const Animation & animation = *draw.animation;
+        const Animation::AnimationView * view = draw.view;
+        if (!view) {
+            // files' visibility and opacity with groups applied, one view per animation
+            uint32_t * index = defaultViewIndex.find(&animation);
+            if (!index) {
+                uint32_t * previous = previousViewIndex.find(&animation);
+                // a reload replaces the layers in place, the kept view would show the old ones
+                if (previous && previousViews[*previous]
+                    && previousViews[*previous]->generation == animation.generation) {
+                    defaultViews.push_back(std::move(previousViews[*previous]));
+                } else {
+                    defaultViews.push_back(std::make_unique<Animation::AnimationView>(animation));
+                }
+                index = &(defaultViewIndex[&animation] = defaultViews.size() - 1);
+            }
+            view = defaultViews[*index].get();
+        }
+        const Palette & palette = view->getPalette(draw.frame);
+        const LookupKey key{&palette, animation.premultiplied, animation.transparentIndex};
+        uint32_t * lookup = lookupIndex.find(key);
+        if (!lookup) {
+            lookups.emplace_back(palette,
+                animation.premultiplied ? PixelLayout::RGBA8 : PixelLayout::RGBA8_PREMULTIPLIED,
+                255, animation.transparentIndex);
+            lookup = &(lookupIndex[key] = lookups.size() - 1);
+        }
+
+        for (const FrameCel & frameCel : animation.getFrameCels(draw.frame)) {
+            if (!view->isLayerVisible(frameCel.layer)) {
+                continue;
+            }
+            const uint8_t opacity = multiplyOpacity(frameCel.cel.opacity, view->getLayerOpacity(frameCel.layer));
+            const Image & image = animation.images[frameCel.cel.image];
+            const int32_t x = draw.x + frameCel.cel.x;
+            const int32_t y = draw.y + frameCel.cel.y;
+            const RleImage * rle = frameCel.cel.image < animation.rleImages.size()
+                ? &animation.rleImages[frameCel.cel.image] : nullptr;
+            if (opacity == 0 || (!rle && image.pixels.size() != size_t(image.width) * image.height)
+                || x >= int32_t(width) || y >= int32_t(height) || x + image.width <= 0 || y + image.height <= 0) {
+                continue;
+            }
+            items.push_back(Item{x, y, &image, rle, *lookup, opacity});
+        }
+    }
+    previousViews.clear(); // views of animations not drawn this time
+
+    // counting sort of the items into the tiles they overlap, keeping draw order
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    tileStart.assign(size_t(tilesX) * tilesY + 1, 0);
+    auto forTiles = [&](const Item & item, auto function) {
+        const uint32_t left = std::max(item.x, 0) / tileSize;
+        const uint32_t top = std::max(item.y, 0) / tileSize;
+        const uint32_t right = std::min<int64_t>(int64_t(item.x) + item.image->width, width) - 1;
+        const uint32_t bottom = std::min<int64_t>(int64_t(item.y) + item.image->height, height) - 1;
+        for (uint32_t ty = top; ty <= bottom / tileSize; ty++) {
+            for (uint32_t tx = left; tx <= right / tileSize; tx++) {
+                function(ty * tilesX + tx);
+            }
+        }
+    };
+    for (const Item & item : items) {
+        forTiles(item, [this](uint32_t tile) { tileStart[tile + 1]++; });
+    }
+    for (size_t t = 1; t < tileStart.size(); t++) {
+        tileStart[t] += tileStart[t - 1];
+    }
+    tileItems.resize(tileStart.back());
+    std::vector<uint32_t> & next = sorted; // no longer needed, reused as fill positions
+    next.assign(tileStart.begin(), tileStart.end() - 1);
+    for (uint32_t i = 0; i < items.size(); i++) {
+        forTiles(items[i], [&](uint32_t tile) { tileItems[next[tile]++] = i; });
+    }
+}
+
+void SpriteBatchRenderer::drawTile(uint32_t tile, uint32_t tilesX, uint8_t * target,
+                                   uint32_t width, uint32_t height, size_t pitch) const {
+    const int32_t tileLeft = (tile % tilesX) * tileSize;
+    const int32_t tileTop = (tile / tilesX) * tileSize;
+    const int32_t tileRight = std::min(tileLeft + tileSize, width);
+    const int32_t tileBottom = std::min(tileTop + tileSize, height);
+    for (uint32_t i = tileStart[tile]; i < tileStart[tile + 1]; i++) {
+        const Item & item = items[tileItems[i]];
+        const Image & image = *item.image;
+        const uint32_t * table = lookups[item.lookup].pixels.data();
+        // clip rectangle in cel coordinates
+        const int32_t left = std::max(tileLeft - item.x, 0);
+        const int32_t right = std::min(tileRight - item.x, int32_t(image.width));
+        const int32_t top = std::max(tileTop - item.y, 0);
+        const int32_t bottom = std::min(tileBottom - item.y, int32_t(image.height));
+        for (int32_t y = top; y < bottom; y++) {
+            uint8_t * row = target + size_t(item.y + y) * pitch;
+            if (item.rle) {
+                const RleImage & rle = *item.rle;
+                for (uint32_t r = rle.rowStart[y]; r < rle.rowStart[y + 1]; r++) {
+                    const RleImage::Run & run = rle.runs[r];
+                    const int32_t first = std::max<int32_t>(run.x, left);
+                    const int32_t end = std::min<int32_t>(run.x + run.length, right);
+                    const uint8_t * color = reinterpret_cast<const uint8_t *>(&table[run.index]);
+                    for (int32_t x = first; x < end; x++) {
+                        blend(row + 4 * (item.x + x), color, item.opacity);
+                    }
+                }
+            } else {
+                const uint8_t * pixels = image.pixels.data() + size_t(y) * image.width;
+                for (int32_t x = left; x < right; x++) {
+                    blend(row + 4 * (item.x + x), reinterpret_cast<const uint8_t *>(&table[pixels[x]]), item.opacity);
+                }
+            }
+        }
+    }
+}
+
+void SpriteBatchRenderer::render(const std::vector<SpriteDraw> & draws, void * target,
+                                 uint32_t width, uint32_t height, size_t pitch) {
+    if (width == 0 || height == 0) {
+        return;
+    }
+    collect(draws, width, height);
+    if (items.empty()) {
+        return;
+    }
+
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    uint8_t * pixels = static_cast<uint8_t *>(target);
+    std::mutex mutex;
+    std::condition_variable done;
+    uint32_t remaining = tilesY;
+    for (uint32_t ty = 0; ty < tilesY; ty++) {
+        pool.submit([&, ty] {
+            for (uint32_t tx = 0; tx < tilesX; tx++) {
+                drawTile(ty * tilesX + tx, tilesX, pixels, width, height, pitch);
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0) {
+                done.notify_one();
+            }
+        });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&remaining] { return remaining == 0; });
+}
+
+}
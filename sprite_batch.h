@@ -0,0 +1,105 @@
+/*
+ * Drawing many sprites into one image
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "animation.h"
+#include "flat_hash_map.h"
+#include "thread_pool.h"
+
+namespace animation {
+
+/**
+ * A frame of an animation drawn at x, y of the target.
+ */
+class SpriteDraw {
+public:
+    const Animation * animation;
+    uint32_t frame;
+    int32_t x;
+    int32_t y;
+    const Animation::AnimationView * view = nullptr; // layers and palette, nullptr -> as in the file
+    int32_t order = 0; // lower is drawn first, draws of equal order in the order of the list
+};
+
+/**
+ * Composites many sprites into one RGBA target. Visible cels of the draws are clipped to the
+ * target and sorted into square tiles, rows of tiles are drawn in parallel on the pool. Every
+ * tile is drawn by one thread, in draw order, so nothing is locked while blending.
+ *
+ * Cels are blended over the target with premultiplied alpha, blend modes other than Normal
+ * are drawn as Normal. Animations with rleImages are drawn from the runs.
+ */
+class SpriteBatchRenderer {
+public:
+    explicit SpriteBatchRenderer(ThreadPool & pool, uint32_t tileSize = 64);
+
+    /**
+     * Draws onto width x height premultiplied RGBA8 pixels, rows pitch bytes apart and 4 byte
+     * aligned. Blocks until the target is done, don't call it from a task of the pool.
+     *
+     * The views made for draws without one are kept for the next render while their animation
+     * is drawn and not reloaded (see Animation::generation). Give draws of an animation whose
+     * layers were changed in place by other means a view of their own.
+     */
+    void render(const std::vector<SpriteDraw> & draws, void * target, uint32_t width, uint32_t height, size_t pitch);
+
+private:
+    struct Item { // a cel overlapping the target
+        int32_t x; // of the cel in the target
+        int32_t y;
+        const Image * image;
+        const RleImage * rle; // nullptr -> pixels of image
+        uint32_t lookup; // index to lookups
+        uint8_t opacity;
+    };
+
+    struct LookupKey { // a lookup depends on the palette and on the animation using it
+        const Palette * palette;
+        bool premultiplied;
+        uint8_t transparentIndex;
+
+        bool operator ==(const LookupKey & other) const {
+            return palette == other.palette && premultiplied == other.premultiplied
+                && transparentIndex == other.transparentIndex;
+        }
+    };
+
+    struct LookupKeyHash {
+        size_t operator ()(const LookupKey & key) const {
+            return std::hash<const Palette *>()(key.palette) ^ (size_t(key.transparentIndex) << 1 | key.premultiplied);
+        }
+    };
+
+    ThreadPool & pool;
+    uint32_t tileSize;
+
+    // reused by every render
+    std::vector<uint32_t> sorted; // indices to draws by order
+    std::vector<Item> items;
+    std::vector<uint32_t> tileStart; // tile -> first index to tileItems, tile count + 1 entries
+    std::vector<uint32_t> tileItems; // indices to items, by tile, in draw order
+    std::vector<PaletteLookup> lookups; // premultiplied
+    FlatHashMap<LookupKey, uint32_t, LookupKeyHash> lookupIndex;
+    std::vector<std::unique_ptr<Animation::AnimationView>> defaultViews; // for draws without a view
+    FlatHashMap<const Animation *, uint32_t> defaultViewIndex;
+    std::vector<std::unique_ptr<Animation::AnimationView>> previousViews; // of the last render, reused by this one
+    FlatHashMap<const Animation *, uint32_t> previousViewIndex;
+
+    void collect(const std::vector<SpriteDraw> & draws, uint32_t width, uint32_t height);
+    void drawTile(uint32_t tile, uint32_t tilesX, uint8_t * target, uint32_t width, uint32_t height, size_t pitch) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Tests of the validation of baked animation files
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * Build from the repository root:
+ *  g++ -std=c++17 -O2 -I. -Itools tests/baked_test.cpp tools/synthetic.cpp animation_baked.cpp aseprite.cpp \
+ *      aseprite_to_animation.cpp collision_mask.cpp image_expand.cpp rle_image.cpp decompressor.cpp \
+ *      decoder_context.cpp load_stats.cpp tinf/tinf.cpp tinf/tdeflate.cpp -o baked_test
+ *  ./baked_test
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "animation_baked.h"
+#include "aseprite.h"
+#include "aseprite_to_animation.h"
+#include "check.h"
+#include "synthetic.h"
+
+using namespace animation;
+
+static const std::string ASE_PATH = "baked_test.aseprite";
+static const std::string BAKED_PATH = "baked_test.aseb";
+static const std::string CORRUPT_PATH = "baked_test_corrupt.aseb";
+
+static std::vector<uint8_t> readFile(const std::string & path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::string & path, const std::vector<uint8_t> & bytes) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+// sprite using every section: tags, slices, masks and a palette per frame
+static bool writeFixture() {
+    synthetic::SpriteSpec spec;
+    spec.width = 40;
+    spec.height = 30;
+    spec.format = aseprite::INDEXED;
+    spec.frames = 4;
+    spec.layers = 3;
+    spec.tags = 2;
+    spec.slices = 2;
+    spec.celDensity = 0.7f;
+    if (!synthetic::makeSprite(spec).write(ASE_PATH)) {
+        return false;
+    }
+    LoadOptions options;
+    options.collisionMasks = true;
+    Animation animation = Animation::loadAseImage(ASE_PATH, options);
+    Palette other = animation.palette;
+    other.colors[1].r ^= 0xFF;
+    animation.palettes = {animation.palette, other};
+    animation.framePalettes.assign(animation.framesCount, 0);
+    animation.framePalettes[1] = 1;
+    return writeBaked(animation, BAKED_PATH);
+}
+
+template <typename T>
+static T * sectionData(std::vector<uint8_t> & bytes, baked::SECTION section, size_t * count = nullptr) {
+    const auto & header = *reinterpret_cast<const baked::BakedHeader *>(bytes.data());
+    if (count) {
+        *count = header.sections[section].size / sizeof(T);
+    }
+    return reinterpret_cast<T *>(bytes.data() + header.sections[section].offset);
+}
+
+// open() must reject the file after corrupt changed it
+static void checkRejected(const std::vector<uint8_t> & original, const char * what,
+                          const std::function<bool(std::vector<uint8_t> &)> & corrupt) {
+    std::vector<uint8_t> bytes = original;
+    if (!corrupt(bytes)) {
+        std::printf("%s: nothing to corrupt in the fixture\n", what);
+        checkFailures++;
+        return;
+    }
+    writeFile(CORRUPT_PATH, bytes);
+    BakedAnimation baked;
+    const bool opened = baked.open(CORRUPT_PATH);
+    if (opened) {
+        std::printf("%s: corrupt file opened\n", what);
+    }
+    CHECK(!opened);
+}
+
+int main() {
+    CHECK(writeFixture());
+    const std::vector<uint8_t> original = readFile(BAKED_PATH);
+    {
+        BakedAnimation baked;
+        CHECK(baked.open(BAKED_PATH));
+        CHECK(baked.hasMasks());
+        CHECK(baked.imagesCount() > 0);
+    }
+
+    checkRejected(original, "truncated", [](std::vector<uint8_t> & bytes) {
+        bytes.resize(bytes.size() - 1);
+        return true;
+    });
+    checkRejected(original, "cel image past IMAGES", [](std::vector<uint8_t> & bytes) {
+        size_t cels = 0;
+        Cel * cel = sectionData<Cel>(bytes, baked::CELS, &cels);
+        size_t images = 0;
+        sectionData<baked::BakedImage>(bytes, baked::IMAGES, &images);
+        for (size_t i = 0; i < cels; i++) {
+            if (cel[i].image != Cel::NO_IMAGE) {
+                cel[i].image = images;
+                return true;
+            }
+        }
+        return false;
+    });
+    checkRejected(original, "empty cel image other than NO_IMAGE", [](std::vector<uint8_t> & bytes) {
+        size_t cels = 0;
+        Cel * cel = sectionData<Cel>(bytes, baked::CELS, &cels);
+        for (size_t i = 0; i < cels; i++) {
+            if (cel[i].image == Cel::NO_IMAGE) {
+                cel[i].image = Cel::NO_IMAGE - 1;
+                return true;
+            }
+        }
+        return false;
+    });
+    const std::pair<baked::SECTION, baked::SECTION> lookups[] = {
+        {baked::ANIMATION_LOOKUP, baked::ANIMATIONS},
+        {baked::SLICE_LOOKUP, baked::SLICES},
+        {baked::LAYER_LOOKUP, baked::LAYERS}
+    };
+    const size_t elementSize[] = {sizeof(baked::BakedRange), sizeof(baked::BakedSlice), sizeof(baked::BakedLayer)};
+    const char * lookupNames[] = {"ANIMATION_LOOKUP past ANIMATIONS", "SLICE_LOOKUP past SLICES", "LAYER_LOOKUP past LAYERS"};
+    for (size_t i = 0; i < std::size(lookups); i++) {
+        const auto [lookup, target] = lookups[i];
+        const size_t size = elementSize[i];
+        checkRejected(original, lookupNames[i], [lookup, target, size](std::vector<uint8_t> & bytes) {
+            const auto & header = *reinterpret_cast<const baked::BakedHeader *>(bytes.data());
+            size_t entries = 0;
+            baked::BakedLookup * entry = sectionData<baked::BakedLookup>(bytes, lookup, &entries);
+            if (entries == 0) {
+                return false;
+            }
+            entry[entries - 1].index = header.sections[target].size / size;
+            return true;
+        });
+    }
+    checkRejected(original, "animation frame past framesCount", [](std::vector<uint8_t> & bytes) {
+        const auto & header = *reinterpret_cast<const baked::BakedHeader *>(bytes.data());
+        size_t count = 0;
+        int32_t * data = sectionData<int32_t>(bytes, baked::ANIMATION_DATA, &count);
+        if (count < 2 || data[0] == -1) {
+            return false;
+        }
+        data[0] = header.framesCount;
+        return true;
+    });
+    checkRejected(original, "negative frame duration", [](std::vector<uint8_t> & bytes) {
+        size_t count = 0;
+        int32_t * data = sectionData<int32_t>(bytes, baked::ANIMATION_DATA, &count);
+        if (count < 2 || data[0] == -1) {
+            return false;
+        }
+        data[1] = -100;
+        return true;
+    });
+    checkRejected(original, "loop past framesCount", [](std::vector<uint8_t> & bytes) {
+        const auto & header = *reinterpret_cast<const baked::BakedHeader *>(bytes.data());
+        size_t count = 0;
+        baked::BakedLoop * loop = sectionData<baked::BakedLoop>(bytes, baked::LOOPS, &count);
+        if (count == 0) {
+            return false;
+        }
+        loop[0].to = header.framesCount;
+        return true;
+    });
+    checkRejected(original, "slice frame key past its keys", [](std::vector<uint8_t> & bytes) {
+        size_t count = 0;
+        baked::BakedSlice * slice = sectionData<baked::BakedSlice>(bytes, baked::SLICES, &count);
+        if (count == 0 || slice[0].frameKeys.count == 0) {
+            return false;
+        }
+        sectionData<uint32_t>(bytes, baked::SLICE_FRAME_KEYS)[slice[0].frameKeys.first] = slice[0].keys.count;
+        return true;
+    });
+    checkRejected(original, "fewer masks than images", [](std::vector<uint8_t> & bytes) {
+        auto & header = *reinterpret_cast<baked::BakedHeader *>(bytes.data());
+        if (header.sections[baked::MASKS].size == 0) {
+            return false;
+        }
+        header.sections[baked::MASKS].size -= sizeof(baked::BakedMask);
+        return true;
+    });
+    checkRejected(original, "frame palette 0", [](std::vector<uint8_t> & bytes) {
+        size_t frames = 0;
+        uint16_t * index = sectionData<uint16_t>(bytes, baked::FRAME_PALETTES, &frames);
+        if (frames == 0) {
+            return false;
+        }
+        index[0] = 0;
+        return true;
+    });
+    checkRejected(original, "frame palette past PALETTE", [](std::vector<uint8_t> & bytes) {
+        size_t frames = 0;
+        size_t palettes = 0;
+        uint16_t * index = sectionData<uint16_t>(bytes, baked::FRAME_PALETTES, &frames);
+        sectionData<Palette>(bytes, baked::PALETTE, &palettes);
+        if (frames == 0) {
+            return false;
+        }
+        index[0] = palettes;
+        return true;
+    });
+
+    std::remove(ASE_PATH.c_str());
+    std::remove(BAKED_PATH.c_str());
+    std::remove(CORRUPT_PATH.c_str());
+    return checkResult();
+}
@@ -0,0 +1,37 @@
+/*
+ * Minimal checks for the test programs
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * Every test in tests/ is a program of its own, built from the repository root with the line at
+ * the top of its file, like the tools (the project build excludes tests and tools). For example:
+ *  g++ -std=c++17 -O2 -I. tests/inflate_test.cpp tinf/tinf.cpp -o inflate_test && ./inflate_test
+ * A test prints the failed checks and exits with 1, or prints "all checks passed".
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+
+static int checkFailures = 0;
+
+// reports a failed condition and keeps going, main returns checkResult()
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            checkFailures++; \
+        } \
+    } while (0)
+
+static int checkResult() {
+    if (checkFailures) {
+        std::printf("%d checks failed\n", checkFailures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Tests of collision masks generated at load time
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * Build from the repository root:
+ *  g++ -std=c++17 -O2 -I. -Itools tests/collision_mask_test.cpp tools/synthetic.cpp aseprite.cpp \
+ *      aseprite_to_animation.cpp collision_mask.cpp image_expand.cpp rle_image.cpp decompressor.cpp \
+ *      decoder_context.cpp load_stats.cpp tinf/tinf.cpp tinf/tdeflate.cpp -o collision_mask_test
+ *  ./collision_mask_test
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "aseprite.h"
+#include "aseprite_to_animation.h"
+#include "check.h"
+#include "synthetic.h"
+
+using namespace animation;
+
+// alpha pattern covering 0 - 255, the gray value is often the transparent index
+static uint8_t alphaAt(uint32_t x, uint32_t y, uint32_t cel) {
+    return uint8_t(x * 7 + y * 13 + cel * 29);
+}
+
+static uint8_t grayAt(uint32_t x, uint32_t y) {
+    return (x + y) % 3 == 0 ? 0 : uint8_t(x * 5 + y);
+}
+
+// fixture with known alpha, wider than a mask word
+static bool writeFixture(const std::string & path, aseprite::PIXELTYPE format) {
+    synthetic::SpriteSpec spec;
+    spec.width = 150;
+    spec.height = 20;
+    spec.format = format;
+    spec.frames = 2;
+    spec.layers = 2;
+    aseprite::ASEPRITE ase = synthetic::makeSprite(spec);
+    ase.header.transparentIndex = 0;
+    uint32_t celIndex = 0;
+    for (auto & frame : ase.frames) {
+        for (auto & chunk : frame.chunks) {
+            if (chunk.type != aseprite::CHUNK_TYPE::CEL_0x2005) {
+                continue;
+            }
+            auto & cel = std::get<aseprite::CEL_CHUNK>(chunk.data);
+            if (cel.type != 2) {
+                continue;
+            }
+            for (uint32_t y = 0; y < cel.height; y++) {
+                for (uint32_t x = 0; x < cel.width; x++) {
+                    auto & pixel = cel.pixels[size_t(y) * cel.width + x];
+                    if (format == aseprite::GRAYSCALE) {
+                        pixel.GRAYSCALE[0] = grayAt(x, y);
+                        pixel.GRAYSCALE[1] = alphaAt(x, y, celIndex);
+                    } else {
+                        pixel.RGBA[0] = pixel.RGBA[1] = pixel.RGBA[2] = grayAt(x, y);
+                        pixel.RGBA[3] = alphaAt(x, y, celIndex);
+                    }
+                }
+            }
+            celIndex++;
+        }
+    }
+    return ase.write(path);
+}
+
+static void testMasks(const std::string & path, uint8_t threshold) {
+    LoadOptions options;
+    options.collisionMasks = true;
+    options.maskAlphaThreshold = threshold;
+    Animation animation = Animation::loadAseImage(path, options);
+    CHECK(animation.images.size() == 4);
+    CHECK(animation.masks.size() == animation.images.size());
+    for (uint32_t i = 0; i < animation.masks.size() && i < animation.images.size(); i++) {
+        const CollisionMask & mask = animation.masks[i];
+        const Image & image = animation.images[i];
+        CHECK(mask.width == image.width && mask.height == image.height);
+        uint32_t wrong = 0;
+        for (uint32_t y = 0; y < mask.height; y++) {
+            for (uint32_t x = 0; x < mask.width; x++) {
+                wrong += mask.test(x, y) != (alphaAt(x, y, i) >= threshold);
+            }
+        }
+        CHECK(wrong == 0);
+    }
+}
+
+int main() {
+    const std::string path = "collision_mask_test.aseprite";
+    for (auto format : {aseprite::GRAYSCALE, aseprite::RGBA}) {
+        CHECK(writeFixture(path, format));
+        testMasks(path, 1);
+        testMasks(path, 128);
+        testMasks(path, 255);
+    }
+    std::remove(path.c_str());
+    return checkResult();
+}
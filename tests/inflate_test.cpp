@@ -0,0 +1,226 @@
+/*
+ * Tests of the match copies and bounds of tinf
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * Build from the repository root:
+ *  g++ -std=c++17 -O2 -I. tests/inflate_test.cpp tinf/tinf.cpp -o inflate_test
+ *  ./inflate_test
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "check.h"
+#include "tinf/tinf.h"
+
+// raw deflate stream of one final block with fixed huffman codes
+class FixedBlock {
+public:
+    FixedBlock() {
+        bits(1, 1); // final
+        bits(1, 2); // fixed codes
+    }
+
+    void literal(uint8_t value) {
+        if (value < 144) {
+            code(0x30 + value, 8);
+        } else {
+            code(0x190 + value - 144, 9);
+        }
+        expected.push_back(value);
+    }
+
+    // 3 <= length <= 258, 1 <= distance <= the output so far
+    void match(uint32_t length, uint32_t distance) {
+        encodeMatch(length, distance);
+        for (uint32_t i = 0; i < length; i++) {
+            expected.push_back(expected[expected.size() - distance]);
+        }
+    }
+
+    // only writes the codes, distance may be invalid, up to 32768
+    void encodeMatch(uint32_t length, uint32_t distance) {
+        static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const uint8_t lengthBits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static const uint8_t distanceBits[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+        int l = 28;
+        while (lengthBase[l] > length) {
+            l--;
+        }
+        const uint32_t symbol = 257 + l;
+        if (symbol < 280) {
+            code(symbol - 256, 7);
+        } else {
+            code(0xC0 + symbol - 280, 8);
+        }
+        bits(length - lengthBase[l], lengthBits[l]);
+        int d = 29;
+        while (distanceBase[d] > distance) {
+            d--;
+        }
+        code(d, 5);
+        bits(distance - distanceBase[d], distanceBits[d]);
+    }
+
+    const std::vector<uint8_t> & finish() {
+        code(0, 7); // end of block
+        if (count) {
+            stream.push_back(buffer);
+        }
+        return stream;
+    }
+
+    std::vector<uint8_t> expected;
+
+private:
+    std::vector<uint8_t> stream;
+    uint32_t buffer = 0;
+    uint32_t count = 0;
+
+    void bits(uint32_t value, uint32_t n) { // least significant first
+        for (uint32_t i = 0; i < n; i++) {
+            buffer |= ((value >> i) & 1) << count;
+            if (++count == 8) {
+                stream.push_back(buffer);
+                buffer = count = 0;
+            }
+        }
+    }
+
+    void code(uint32_t value, uint32_t n) { // huffman codes go most significant first
+        for (uint32_t i = n; i-- > 0;) {
+            bits(value >> i, 1);
+        }
+    }
+};
+
+static const uint8_t CANARY = 0xA5;
+
+static bool canaryIntact(const std::vector<uint8_t> & buffer, size_t from) {
+    for (size_t i = from; i < buffer.size(); i++) {
+        if (buffer[i] != CANARY) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the stream inflated by every entry point: unbounded with slack, bounded and resumable
+// with exactly the output size, every match can end at the end of the output
+static void checkInflate(FixedBlock & block, const char * what) {
+    const std::vector<uint8_t> & stream = block.finish();
+    const std::vector<uint8_t> & expected = block.expected;
+    const size_t size = expected.size();
+    unsigned int length = 0;
+    bool ok;
+
+    std::vector<uint8_t> slack(size + TINF_DEST_SLACK, CANARY);
+    ok = tinf_uncompress(slack.data(), &length, stream.data(), stream.size()) == TINF_OK
+        && length == size && std::memcmp(slack.data(), expected.data(), size) == 0;
+    if (!ok) std::printf("%s: tinf_uncompress\n", what);
+    CHECK(ok);
+
+    std::vector<uint8_t> exact(size + 64, CANARY);
+    ok = tinf_uncompress_bounded(exact.data(), size, &length, stream.data(), stream.size()) == TINF_OK
+        && length == size && std::memcmp(exact.data(), expected.data(), size) == 0 && canaryIntact(exact, size);
+    if (!ok) std::printf("%s: tinf_uncompress_bounded\n", what);
+    CHECK(ok);
+
+    std::vector<uint8_t> streamed(size + 64, CANARY);
+    TINF_STREAM s;
+    tinf_stream_init(&s, streamed.data(), size, 0);
+    unsigned int consumed = 0;
+    int res = TINF_NEED_INPUT;
+    for (size_t offset = 0; offset < stream.size() && res == TINF_NEED_INPUT; offset += consumed) {
+        res = tinf_stream_inflate(&s, stream.data() + offset, 1, &consumed); // byte by byte
+    }
+    ok = res == TINF_OK && s.destLen == size && std::memcmp(streamed.data(), expected.data(), size) == 0
+        && canaryIntact(streamed, size);
+    if (!ok) std::printf("%s: tinf_stream_inflate\n", what);
+    CHECK(ok);
+
+    // one byte short, the match doesn't fit
+    if (size > 0) {
+        std::vector<uint8_t> small(size + 64, CANARY);
+        res = tinf_uncompress_bounded(small.data(), size - 1, &length, stream.data(), stream.size());
+        ok = res == TINF_BUF_ERROR && length <= size - 1 && canaryIntact(small, size - 1);
+        if (!ok) std::printf("%s: tinf_uncompress_bounded one byte short returned %d\n", what, res);
+        CHECK(ok);
+
+        std::fill(small.begin(), small.end(), CANARY);
+        tinf_stream_init(&s, small.data(), size - 1, 0);
+        res = tinf_stream_inflate(&s, stream.data(), stream.size(), &consumed);
+        ok = res == TINF_BUF_ERROR && canaryIntact(small, size - 1);
+        if (!ok) std::printf("%s: tinf_stream_inflate one byte short returned %d\n", what, res);
+        CHECK(ok);
+    }
+}
+
+int main() {
+    tinf_init();
+    const uint32_t lengths[] = {3, 4, 7, 8, 9, 15, 16, 17, 31, 32, 33, 100, 257, 258};
+    char what[64];
+
+    // overlapping matches of every short distance, each ending the output
+    for (uint32_t distance = 1; distance <= 15; distance++) {
+        for (uint32_t length : lengths) {
+            FixedBlock block;
+            for (uint32_t i = 0; i < distance; i++) {
+                block.literal(uint8_t(i * 37 + distance));
+            }
+            block.match(length, distance);
+            std::snprintf(what, sizeof(what), "distance %u length %u", distance, length);
+            checkInflate(block, what);
+        }
+    }
+
+    // wide copies of longer distances and matches followed by more output
+    for (uint32_t distance : {16u, 17u, 24u, 31u, 32u, 100u}) {
+        for (uint32_t length : lengths) {
+            FixedBlock block;
+            for (uint32_t i = 0; i < distance; i++) {
+                block.literal(uint8_t(i * 73 + 1));
+            }
+            block.match(length, distance);
+            block.literal(0xEE);
+            block.match(length, 1);
+            block.match(3, distance);
+            std::snprintf(what, sizeof(what), "distance %u length %u, followed", distance, length);
+            checkInflate(block, what);
+        }
+    }
+
+    // back reference before the start of the output
+    {
+        FixedBlock block;
+        block.literal(1);
+        block.literal(2);
+        block.encodeMatch(3, 3);
+        const std::vector<uint8_t> & stream = block.finish();
+        std::vector<uint8_t> buffer(64, CANARY);
+        unsigned int length = 0;
+        CHECK(tinf_uncompress_bounded(buffer.data(), 32, &length, stream.data(), stream.size()) == TINF_DIST_ERROR);
+        CHECK(canaryIntact(buffer, 2));
+    }
+
+    // input ending inside the block
+    {
+        FixedBlock block;
+        for (uint32_t i = 0; i < 20; i++) {
+            block.literal(uint8_t(i));
+        }
+        std::vector<uint8_t> stream = block.finish();
+        stream.resize(stream.size() / 2);
+        std::vector<uint8_t> buffer(64, CANARY);
+        unsigned int length = 0;
+        CHECK(tinf_uncompress_bounded(buffer.data(), 32, &length, stream.data(), stream.size()) == TINF_SOURCE_ERROR);
+    }
+    return checkResult();
+}
@@ -0,0 +1,66 @@
+/*
+ * Worker threads for loading and rendering
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#include <algorithm>
+#include <utility>
+#include "thread_pool.h"
+
+namespace animation {
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers.reserve(threads);
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+// heap order, the top is the task to run next
+bool ThreadPool::runsAfter(const Task & a, const Task & b) {
+    return a.priority < b.priority || (a.priority == b.priority && a.sequence > b.sequence);
+}
+
+void ThreadPool::submit(std::function<void()> task, int priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(Task{priority, sequence++, std::move(task)});
+        std::push_heap(tasks.begin(), tasks.end(), runsAfter);
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return; // stopping and nothing left
+            }
+            std::pop_heap(tasks.begin(), tasks.end(), runsAfter);
+            task = std::move(tasks.back().run);
+            tasks.pop_back();
+        }
+        task();
+    }
+}
+
+}
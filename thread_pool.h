@@ -0,0 +1,64 @@
+/*
+ * Worker threads for loading and rendering
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace animation {
+
+/**
+ * Fixed set of threads running submitted tasks, higher priority first,
+ * tasks of equal priority in the order they were submitted.
+ * The destructor runs the tasks still queued and joins the threads.
+ */
+class ThreadPool {
+public:
+    /**
+     * 0 threads -> one per hardware thread.
+     */
+    explicit ThreadPool(unsigned threads = 0);
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator =(const ThreadPool &) = delete;
+
+    ~ThreadPool();
+
+    void submit(std::function<void()> task, int priority = 0);
+
+    unsigned size() const {
+        return workers.size();
+    }
+
+private:
+    struct Task {
+        int priority;
+        uint64_t sequence;
+        std::function<void()> run;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Task> tasks; // heap, see runsAfter
+    uint64_t sequence = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    static bool runsAfter(const Task & a, const Task & b);
+
+    void work();
+};
+
+}
+
+#endif
@@ -0,0 +1,745 @@
+/*
+ * tdeflate  -  tiny deflate, the counterpart of tinf
+ *
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * This software is provided 'as-is', without any express
+ * or implied warranty.  In no event will the authors be
+ * held liable for any damages arising from the use of
+ * this software.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "tdeflate.h"
+
+/* ------------------------------ *
+ * -- internal data structures -- *
+ * ------------------------------ */
+
+typedef struct {
+   unsigned char *dest;
+   unsigned char *dest_end;
+   unsigned long long bitbuf;
+   unsigned int bitcount;
+   int overflow; /* set once writing past dest_end */
+} TDEFLATE_OUT;
+
+typedef struct {
+   unsigned short code[288]; /* bit reversed, ready to be written */
+   unsigned char len[288];
+} TDEFLATE_CODE;
+
+/* match finder parameters of a level, as in zlib */
+typedef struct {
+   unsigned short good;  /* quarter the chain when the previous match is this long */
+   unsigned short lazy;  /* lazy: don't search after a match this long,
+                            greedy: longest match whose positions are hashed */
+   unsigned short nice;  /* stop searching at a match this long */
+   unsigned short chain; /* candidates tried per position */
+} TDEFLATE_LEVEL;
+
+/* ------------------------------ *
+ * -- constant tables          -- *
+ * ------------------------------ */
+
+static const TDEFLATE_LEVEL tdeflate_levels[TDEFLATE_MAX_LEVEL + 1] = {
+   { 0, 0, 0, 0 },         /* stored */
+   { 4, 4, 8, 4 },         /* greedy */
+   { 4, 5, 16, 8 },
+   { 4, 6, 32, 32 },
+   { 4, 4, 16, 16 },       /* lazy */
+   { 8, 16, 32, 32 },
+   { 8, 16, 128, 128 },
+   { 8, 32, 128, 256 },
+   { 32, 128, 258, 1024 },
+   { 32, 258, 258, 4096 }
+};
+
+static const unsigned short tdeflate_length_base[29] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const unsigned char tdeflate_length_bits[29] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const unsigned short tdeflate_dist_base[30] = {
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const unsigned char tdeflate_dist_bits[30] = {
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* special ordering of code length codes */
+static const unsigned char tdeflate_clcidx[19] = {
+   16, 17, 18, 0, 8, 7, 9, 6,
+   10, 5, 11, 4, 12, 3, 13, 2,
+   14, 1, 15
+};
+
+/* ----------------------- *
+ * -- utility functions -- *
+ * ----------------------- */
+
+static unsigned int tdeflate_log2(unsigned int x)
+{
+#ifdef __GNUC__
+   return 31 - __builtin_clz(x);
+#else
+   unsigned int r = 0;
+   while (x >>= 1) ++r;
+   return r;
+#endif
+}
+
+/* index to the length tables of a match length 3 - 258 */
+static unsigned int tdeflate_length_code(unsigned int length)
+{
+   unsigned int l = length - 3, e;
+
+   if (length == 258) return 28;
+   if (l < 8) return l;
+
+   e = tdeflate_log2(l) - 2;
+   return 4 * (e + 1) + ((l >> e) & 3);
+}
+
+/* distance code of a distance 1 - 32768 */
+static unsigned int tdeflate_dist_code(unsigned int dist)
+{
+   unsigned int d = dist - 1, e;
+
+   if (d < 4) return d;
+
+   e = tdeflate_log2(d) - 1;
+   return 2 * e + 2 + ((d >> e) & 1);
+}
+
+static unsigned int tdeflate_adler32(const unsigned char *data, unsigned int length)
+{
+   unsigned int a = 1, b = 0;
+
+   while (length > 0)
+   {
+      /* largest block keeping b from overflowing */
+      unsigned int n = length < 5552 ? length : 5552;
+      length -= n;
+      while (n--)
+      {
+         a += *data++;
+         b += a;
+      }
+      a %= 65521;
+      b %= 65521;
+   }
+
+   return (b << 16) | a;
+}
+
+/* ------------------- *
+ * -- bit output    -- *
+ * ------------------- */
+
+static void tdeflate_bits(TDEFLATE_OUT *o, unsigned int bits, unsigned int num)
+{
+   o->bitbuf |= (unsigned long long)bits << o->bitcount;
+   o->bitcount += num;
+
+   if (o->bitcount >= 32)
+   {
+      if (o->dest_end - o->dest >= 4)
+      {
+         o->dest[0] = (unsigned char)o->bitbuf;
+         o->dest[1] = (unsigned char)(o->bitbuf >> 8);
+         o->dest[2] = (unsigned char)(o->bitbuf >> 16);
+         o->dest[3] = (unsigned char)(o->bitbuf >> 24);
+         o->dest += 4;
+      } else {
+         o->overflow = 1;
+      }
+      o->bitbuf >>= 32;
+      o->bitcount -= 32;
+   }
+}
+
+/* pad to a byte boundary and write out the buffered bits */
+static void tdeflate_flush(TDEFLATE_OUT *o)
+{
+   while (o->bitcount > 0)
+   {
+      if (o->dest < o->dest_end) *o->dest++ = (unsigned char)o->bitbuf;
+      else o->overflow = 1;
+      o->bitbuf >>= 8;
+      o->bitcount = o->bitcount > 8 ? o->bitcount - 8 : 0;
+   }
+}
+
+/* write bytes, the output must be byte aligned */
+static void tdeflate_bytes(TDEFLATE_OUT *o, const unsigned char *src, unsigned int length)
+{
+   /* src of an empty stored block may be null */
+   if (length == 0) return;
+
+   if ((unsigned int)(o->dest_end - o->dest) < length)
+   {
+      o->overflow = 1;
+      return;
+   }
+   memcpy(o->dest, src, length);
+   o->dest += length;
+}
+
+/* ------------------- *
+ * -- huffman codes -- *
+ * ------------------- */
+
+static int tdeflate_compare(const void *a, const void *b)
+{
+   unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+   return (x > y) - (x < y);
+}
+
+/* minimum redundancy code lengths (Moffat and Katajainen, in place),
+   A holds n ascending weights and receives the lengths, longest first */
+static void tdeflate_moffat(int *A, int n)
+{
+   int root, leaf, next, avbl, used, dpth;
+
+   A[0] += A[1];
+   root = 0;
+   leaf = 2;
+   for (next = 1; next < n - 1; ++next)
+   {
+      if (leaf >= n || A[root] < A[leaf]) { A[next] = A[root]; A[root++] = next; }
+      else A[next] = A[leaf++];
+
+      if (leaf >= n || (root < next && A[root] < A[leaf])) { A[next] += A[root]; A[root++] = next; }
+      else A[next] += A[leaf++];
+   }
+
+   A[n - 2] = 0;
+   for (next = n - 3; next >= 0; --next) A[next] = A[A[next]] + 1;
+
+   avbl = 1;
+   used = dpth = 0;
+   root = n - 2;
+   next = n - 1;
+   while (avbl > 0)
+   {
+      while (root >= 0 && A[root] == dpth) { ++used; --root; }
+      while (avbl > used) { A[next--] = dpth; --avbl; }
+      avbl = 2 * used;
+      ++dpth;
+      used = 0;
+   }
+}
+
+/* code lengths of at most max_len bits for num symbols,
+   at least two symbols get a code so decoders see a complete code */
+static void tdeflate_build_lengths(unsigned char *len, const unsigned int *freq, int num, unsigned int max_len)
+{
+   unsigned int sorted[288]; /* freq << 9 | symbol */
+   int A[288];
+   int count[16];
+   unsigned int total;
+   int n = 0, i, j;
+
+   memset(len, 0, num);
+
+   for (i = 0; i < num; ++i)
+   {
+      if (freq[i]) sorted[n++] = (freq[i] << 9) | i;
+   }
+
+   if (n < 2)
+   {
+      i = n ? sorted[0] & 511 : 0;
+      len[i] = 1;
+      len[i ? 0 : 1] = 1;
+      return;
+   }
+
+   qsort(sorted, n, sizeof(sorted[0]), tdeflate_compare);
+
+   for (i = 0; i < n; ++i) A[i] = sorted[i] >> 9;
+
+   tdeflate_moffat(A, n);
+
+   /* move codes longer than max_len up, then lengthen shorter
+      ones until the code is not over-subscribed */
+   memset(count, 0, sizeof(count));
+   for (i = 0; i < n; ++i) count[(unsigned int)A[i] > max_len ? max_len : A[i]]++;
+
+   total = 0;
+   for (i = max_len; i > 0; --i) total += (unsigned int)count[i] << (max_len - i);
+
+   while (total > (1u << max_len))
+   {
+      count[max_len]--;
+      for (i = max_len - 1; i > 0; --i)
+      {
+         if (count[i]) { count[i]--; count[i + 1] += 2; break; }
+      }
+      total--;
+   }
+
+   /* longest codes go to the least frequent symbols */
+   j = 0;
+   for (i = max_len; i > 0; --i)
+   {
+      int c;
+      for (c = count[i]; c > 0; --c) len[sorted[j++] & 511] = i;
+   }
+}
+
+/* canonical codes from code lengths */
+static void tdeflate_build_code(TDEFLATE_CODE *c, const unsigned char *len, int num)
+{
+   unsigned short bl_count[16], next_code[16];
+   unsigned int code = 0;
+   int i;
+
+   memset(bl_count, 0, sizeof(bl_count));
+   for (i = 0; i < num; ++i) bl_count[len[i]]++;
+   bl_count[0] = 0;
+
+   for (i = 1; i < 16; ++i)
+   {
+      code = (code + bl_count[i - 1]) << 1;
+      next_code[i] = code;
+   }
+
+   for (i = 0; i < num; ++i)
+   {
+      unsigned int l = len[i], value, reversed = 0, k;
+      c->len[i] = l;
+      if (!l) continue;
+      value = next_code[l]++;
+      for (k = 0; k < l; ++k) reversed |= ((value >> k) & 1) << (l - 1 - k);
+      c->code[i] = reversed;
+   }
+}
+
+static void tdeflate_fixed_codes(TDEFLATE_CODE *lcode, TDEFLATE_CODE *dcode)
+{
+   unsigned char len[288];
+   int i;
+
+   for (i = 0; i < 144; ++i) len[i] = 8;
+   for (; i < 256; ++i) len[i] = 9;
+   for (; i < 280; ++i) len[i] = 7;
+   for (; i < 288; ++i) len[i] = 8;
+   tdeflate_build_code(lcode, len, 288);
+
+   for (i = 0; i < 30; ++i) len[i] = 5;
+   tdeflate_build_code(dcode, len, 30);
+}
+
+/* ------------------- *
+ * -- block output  -- *
+ * ------------------- */
+
+static void tdeflate_write_stored(TDEFLATE_OUT *o, const unsigned char *src, unsigned int length, int final)
+{
+   do {
+      unsigned int n = length > 65535 ? 65535 : length;
+      unsigned char header[4];
+
+      length -= n;
+      tdeflate_bits(o, final && length == 0, 3);
+      tdeflate_flush(o);
+
+      header[0] = (unsigned char)n;
+      header[1] = (unsigned char)(n >> 8);
+      header[2] = (unsigned char)~n;
+      header[3] = (unsigned char)(~n >> 8);
+      tdeflate_bytes(o, header, 4);
+      tdeflate_bytes(o, src, n);
+      src += n;
+   } while (length > 0);
+}
+
+static void tdeflate_write_tokens(const TDEFLATE_STATE *s, TDEFLATE_OUT *o, unsigned int ntok,
+                                  const TDEFLATE_CODE *lcode, const TDEFLATE_CODE *dcode)
+{
+   unsigned int i;
+
+   for (i = 0; i < ntok; ++i)
+   {
+      unsigned int litlen = s->litlen[i], dist = s->dist[i];
+
+      if (!dist)
+      {
+         tdeflate_bits(o, lcode->code[litlen], lcode->len[litlen]);
+      } else {
+         unsigned int lc = tdeflate_length_code(litlen), dc = tdeflate_dist_code(dist);
+
+         tdeflate_bits(o, lcode->code[257 + lc], lcode->len[257 + lc]);
+         tdeflate_bits(o, litlen - tdeflate_length_base[lc], tdeflate_length_bits[lc]);
+         tdeflate_bits(o, dcode->code[dc], dcode->len[dc]);
+         tdeflate_bits(o, dist - tdeflate_dist_base[dc], tdeflate_dist_bits[dc]);
+      }
+   }
+
+   /* end of block */
+   tdeflate_bits(o, lcode->code[256], lcode->len[256]);
+}
+
+/* write the tokens of source bytes block as the cheapest of stored,
+   fixed and dynamic blocks */
+static void tdeflate_write_block(const TDEFLATE_STATE *s, TDEFLATE_OUT *o, unsigned int ntok,
+                                 const unsigned char *block, unsigned int blockLen, int final,
+                                 const TDEFLATE_CODE *fixed_lcode, const TDEFLATE_CODE *fixed_dcode)
+{
+   unsigned int lfreq[286], dfreq[30], clfreq[19];
+   unsigned char lens[286 + 30], dlen[30], cllen[19];
+   unsigned char rle_sym[286 + 30], rle_extra[286 + 30];
+   unsigned int hlit, hdist, hclen, nrle = 0, total, i;
+   unsigned long long extra_bits = 0, fixed_bits, dynamic_bits, stored_bits;
+   TDEFLATE_CODE lcode, dcode, clcode;
+
+   memset(lfreq, 0, sizeof(lfreq));
+   memset(dfreq, 0, sizeof(dfreq));
+
+   for (i = 0; i < ntok; ++i)
+   {
+      if (!s->dist[i])
+      {
+         lfreq[s->litlen[i]]++;
+      } else {
+         lfreq[257 + tdeflate_length_code(s->litlen[i])]++;
+         dfreq[tdeflate_dist_code(s->dist[i])]++;
+      }
+   }
+   lfreq[256] = 1;
+
+   for (i = 0; i < 29; ++i) extra_bits += (unsigned long long)lfreq[257 + i] * tdeflate_length_bits[i];
+   for (i = 0; i < 30; ++i) extra_bits += (unsigned long long)dfreq[i] * tdeflate_dist_bits[i];
+
+   /* dynamic code lengths */
+   tdeflate_build_lengths(lens, lfreq, 286, 15);
+   tdeflate_build_lengths(dlen, dfreq, 30, 15);
+
+   for (hlit = 286; hlit > 257 && !lens[hlit - 1]; --hlit) ;
+   for (hdist = 30; hdist > 1 && !dlen[hdist - 1]; --hdist) ;
+
+   tdeflate_build_code(&lcode, lens, hlit);
+   tdeflate_build_code(&dcode, dlen, hdist);
+
+   /* run length encode the code lengths with symbols 16 - 18 */
+   memcpy(lens + hlit, dlen, hdist);
+   total = hlit + hdist;
+   for (i = 0; i < total; )
+   {
+      unsigned int cur = lens[i], run = 1;
+
+      while (i + run < total && lens[i + run] == cur) ++run;
+      i += run;
+
+      if (cur == 0)
+      {
+         while (run >= 11)
+         {
+            unsigned int r = run > 138 ? 138 : run;
+            rle_sym[nrle] = 18; rle_extra[nrle++] = r - 11;
+            run -= r;
+         }
+         if (run >= 3)
+         {
+            rle_sym[nrle] = 17; rle_extra[nrle++] = run - 3;
+            run = 0;
+         }
+      } else {
+         rle_sym[nrle] = cur; rle_extra[nrle++] = 0;
+         run--;
+         while (run >= 3)
+         {
+            unsigned int r = run > 6 ? 6 : run;
+            rle_sym[nrle] = 16; rle_extra[nrle++] = r - 3;
+            run -= r;
+         }
+      }
+      for (; run > 0; --run) { rle_sym[nrle] = cur; rle_extra[nrle++] = 0; }
+   }
+
+   memset(clfreq, 0, sizeof(clfreq));
+   for (i = 0; i < nrle; ++i) clfreq[rle_sym[i]]++;
+   tdeflate_build_lengths(cllen, clfreq, 19, 7);
+   tdeflate_build_code(&clcode, cllen, 19);
+   for (hclen = 19; hclen > 4 && !cllen[tdeflate_clcidx[hclen - 1]]; --hclen) ;
+
+   /* sizes of the alternatives in bits */
+   dynamic_bits = 3 + 14 + 3 * hclen + 2 * clfreq[16] + 3 * clfreq[17] + 7 * clfreq[18] + extra_bits;
+   for (i = 0; i < 19; ++i) dynamic_bits += (unsigned long long)clfreq[i] * cllen[i];
+   for (i = 0; i < hlit; ++i) dynamic_bits += (unsigned long long)lfreq[i] * lcode.len[i];
+   for (i = 0; i < hdist; ++i) dynamic_bits += (unsigned long long)dfreq[i] * dcode.len[i];
+
+   fixed_bits = 3 + extra_bits;
+   for (i = 0; i < 286; ++i) fixed_bits += (unsigned long long)lfreq[i] * fixed_lcode->len[i];
+   for (i = 0; i < 30; ++i) fixed_bits += (unsigned long long)dfreq[i] * 5;
+
+   stored_bits = 8ull * blockLen + (3 + 7 + 32) * (blockLen / 65535 + 1);
+
+   if (stored_bits <= fixed_bits && stored_bits <= dynamic_bits)
+   {
+      tdeflate_write_stored(o, block, blockLen, final);
+   } else if (fixed_bits <= dynamic_bits) {
+      tdeflate_bits(o, final | (1 << 1), 3);
+      tdeflate_write_tokens(s, o, ntok, fixed_lcode, fixed_dcode);
+   } else {
+      tdeflate_bits(o, final | (2 << 1), 3);
+      tdeflate_bits(o, hlit - 257, 5);
+      tdeflate_bits(o, hdist - 1, 5);
+      tdeflate_bits(o, hclen - 4, 4);
+      for (i = 0; i < hclen; ++i) tdeflate_bits(o, cllen[tdeflate_clcidx[i]], 3);
+      for (i = 0; i < nrle; ++i)
+      {
+         unsigned int sym = rle_sym[i];
+         tdeflate_bits(o, clcode.code[sym], clcode.len[sym]);
+         if (sym == 16) tdeflate_bits(o, rle_extra[i], 2);
+         else if (sym == 17) tdeflate_bits(o, rle_extra[i], 3);
+         else if (sym == 18) tdeflate_bits(o, rle_extra[i], 7);
+      }
+      tdeflate_write_tokens(s, o, ntok, &lcode, &dcode);
+   }
+}
+
+/* ------------------- *
+ * -- match finder  -- *
+ * ------------------- */
+
+/* hashes the 3 bytes at pos, returns the previous position with the same hash or -1 */
+static int tdeflate_insert(TDEFLATE_STATE *s, const unsigned char *src, unsigned int pos, unsigned int shift)
+{
+   const unsigned char *p = src + pos;
+   unsigned int h = ((p[0] | (p[1] << 8) | ((unsigned int)p[2] << 16)) * 2654435761u) >> shift;
+   int cand = s->head[h];
+
+   s->prev[pos & (TDEFLATE_WINDOW_SIZE - 1)] = cand;
+   s->head[h] = pos;
+
+   return cand;
+}
+
+static unsigned int tdeflate_match_length(const unsigned char *a, const unsigned char *b, unsigned int limit)
+{
+   unsigned int len = 0;
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   while (len + 8 <= limit)
+   {
+      unsigned long long x, y;
+      memcpy(&x, a + len, 8);
+      memcpy(&y, b + len, 8);
+      if (x != y) return len + (__builtin_ctzll(x ^ y) >> 3);
+      len += 8;
+   }
+#endif
+
+   while (len < limit && a[len] == b[len]) ++len;
+
+   return len;
+}
+
+/* longest match at pos longer than best following the hash chain from cand,
+   returns 0 if there is none */
+static unsigned int tdeflate_longest(const TDEFLATE_STATE *s, const unsigned char *src, unsigned int pos, unsigned int n,
+                                     int cand, unsigned int chain, unsigned int nice, unsigned int best, unsigned int *dist)
+{
+   const unsigned char *cur = src + pos;
+   unsigned int limit = n - pos < 258 ? n - pos : 258;
+   unsigned int found = 0;
+
+   if (best >= limit) return 0;
+   if (nice > limit) nice = limit;
+
+   while (cand >= 0 && chain-- > 0)
+   {
+      const unsigned char *m = src + cand;
+      int next;
+
+      if (pos - cand > TDEFLATE_WINDOW_SIZE) break;
+
+      if (m[best] == cur[best] && m[0] == cur[0] && m[1] == cur[1])
+      {
+         unsigned int len = tdeflate_match_length(cur, m, limit);
+         if (len > best)
+         {
+            best = len;
+            *dist = pos - cand;
+            found = 1;
+            if (len >= nice) break;
+         }
+      }
+
+      /* entries older than the window may have been overwritten */
+      next = s->prev[cand & (TDEFLATE_WINDOW_SIZE - 1)];
+      if (next >= cand) break;
+      cand = next;
+   }
+
+   return found ? best : 0;
+}
+
+static void tdeflate_lz(TDEFLATE_STATE *s, TDEFLATE_OUT *o, const unsigned char *src, unsigned int n,
+                        const TDEFLATE_LEVEL *p, int lazy)
+{
+   TDEFLATE_CODE fixed_lcode, fixed_dcode;
+   unsigned int hash_bits = TDEFLATE_HASH_BITS, shift;
+   unsigned int pos = 0, block_start = 0, covered = 0, ntok = 0;
+   unsigned int prev_len = 0, prev_dist = 0;
+   int have_prev = 0;
+
+   tdeflate_fixed_codes(&fixed_lcode, &fixed_dcode);
+
+   /* small inputs get a small hash table, it is cleared for every stream */
+   while (hash_bits > 8 && (1u << (hash_bits - 1)) >= n) --hash_bits;
+   shift = 32 - hash_bits;
+   memset(s->head, 0xff, sizeof(s->head[0]) << hash_bits);
+
+   while (pos < n)
+   {
+      unsigned int len = 0, dist = 0, i;
+
+      if (lazy)
+      {
+         if (pos + 3 <= n)
+         {
+            int cand = tdeflate_insert(s, src, pos, shift);
+            if (!have_prev || prev_len < p->lazy)
+            {
+               unsigned int chain = have_prev && prev_len >= p->good ? p->chain >> 2 : p->chain;
+               len = tdeflate_longest(s, src, pos, n, cand, chain, p->nice, have_prev && prev_len > 2 ? prev_len : 2, &dist);
+               if (len == 3 && dist > 4096) len = 0; /* too far to pay off */
+            }
+         }
+
+         if (have_prev && prev_len >= 3 && len <= prev_len)
+         {
+            /* the match at pos - 1 wins */
+            unsigned int end = pos - 1 + prev_len;
+            s->litlen[ntok] = prev_len;
+            s->dist[ntok++] = prev_dist;
+            for (i = pos + 1; i < end; ++i)
+            {
+               if (i + 3 <= n) tdeflate_insert(s, src, i, shift);
+            }
+            pos = covered = end;
+            have_prev = 0;
+            prev_len = 0;
+         } else {
+            if (have_prev)
+            {
+               s->litlen[ntok] = src[pos - 1];
+               s->dist[ntok++] = 0;
+               covered = pos;
+            }
+            have_prev = 1;
+            prev_len = len;
+            prev_dist = dist;
+            pos++;
+         }
+      } else {
+         if (pos + 3 <= n)
+         {
+            int cand = tdeflate_insert(s, src, pos, shift);
+            len = tdeflate_longest(s, src, pos, n, cand, p->chain, p->nice, 2, &dist);
+            if (len == 3 && dist > 4096) len = 0;
+         }
+
+         if (len)
+         {
+            s->litlen[ntok] = len;
+            s->dist[ntok++] = dist;
+            if (len <= p->lazy)
+            {
+               for (i = pos + 1; i < pos + len; ++i)
+               {
+                  if (i + 3 <= n) tdeflate_insert(s, src, i, shift);
+               }
+            }
+            pos += len;
+         } else {
+            s->litlen[ntok] = src[pos];
+            s->dist[ntok++] = 0;
+            pos++;
+         }
+         covered = pos;
+      }
+
+      if (ntok == TDEFLATE_BLOCK_TOKENS)
+      {
+         tdeflate_write_block(s, o, ntok, src + block_start, covered - block_start, 0, &fixed_lcode, &fixed_dcode);
+         block_start = covered;
+         ntok = 0;
+      }
+   }
+
+   if (have_prev)
+   {
+      s->litlen[ntok] = src[n - 1];
+      s->dist[ntok++] = 0;
+   }
+
+   tdeflate_write_block(s, o, ntok, src + block_start, n - block_start, 1, &fixed_lcode, &fixed_dcode);
+}
+
+/* ------------------------- *
+ * -- public functions    -- *
+ * ------------------------- */
+
+unsigned int tdeflate_bound(unsigned int sourceLen)
+{
+   return sourceLen + (sourceLen >> 11) + 64;
+}
+
+int tdeflate_zlib_compress(TDEFLATE_STATE *s, void *dest, unsigned int destCapacity, unsigned int *destLen,
+                           const void *source, unsigned int sourceLen, int level)
+{
+   const unsigned char *src = (const unsigned char *)source;
+   unsigned char trailer[4];
+   unsigned int adler;
+   TDEFLATE_OUT o;
+
+   if (level < 0) level = 0;
+   if (level > TDEFLATE_MAX_LEVEL) level = TDEFLATE_MAX_LEVEL;
+
+   o.dest = (unsigned char *)dest;
+   o.dest_end = o.dest + destCapacity;
+   o.bitbuf = 0;
+   o.bitcount = 0;
+   o.overflow = 0;
+
+   /* deflate with 32K window, FLEVEL hint, header check bits */
+   tdeflate_bits(&o, 0x78, 8);
+   tdeflate_bits(&o, level < 2 ? 0x01 : level < 6 ? 0x5e : level == 6 ? 0x9c : 0xda, 8);
+
+   if (level == 0)
+   {
+      tdeflate_write_stored(&o, src, sourceLen, 1);
+   } else {
+      tdeflate_lz(s, &o, src, sourceLen, &tdeflate_levels[level], level >= 4);
+   }
+   tdeflate_flush(&o);
+
+   adler = tdeflate_adler32(src, sourceLen);
+   trailer[0] = (unsigned char)(adler >> 24);
+   trailer[1] = (unsigned char)(adler >> 16);
+   trailer[2] = (unsigned char)(adler >> 8);
+   trailer[3] = (unsigned char)adler;
+   tdeflate_bytes(&o, trailer, 4);
+
+   if (o.overflow) return TDEFLATE_BUF_ERROR;
+
+   *destLen = (unsigned int)(o.dest - (unsigned char *)dest);
+
+   return TDEFLATE_OK;
+}
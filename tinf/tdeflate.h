@@ -0,0 +1,43 @@
+/*
+ * tdeflate  -  tiny deflate, the counterpart of tinf
+ *
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * Produces zlib streams (header, deflate blocks, adler32).
+ * Level 0 stores the data, levels 1 - 3 use greedy matching with short
+ * hash chains, levels 4 - 9 lazy matching with progressively longer chains.
+ * Every block is emitted stored, with fixed or with dynamic (length limited)
+ * huffman codes, whichever is the smallest.
+ */
+
+#ifndef TDEFLATE_H_INCLUDED
+#define TDEFLATE_H_INCLUDED
+
+#define TDEFLATE_OK           0
+#define TDEFLATE_BUF_ERROR  (-5) /* output doesn't fit in destCapacity */
+
+#define TDEFLATE_MAX_LEVEL     9
+#define TDEFLATE_DEFAULT_LEVEL 6
+
+#define TDEFLATE_HASH_BITS    15
+#define TDEFLATE_WINDOW_SIZE  32768
+#define TDEFLATE_BLOCK_TOKENS 16384
+
+/* match finder and block buffers, large (about 320 KB), allocate it
+   once and reuse it, it needs no initialization */
+typedef struct {
+   int head[1 << TDEFLATE_HASH_BITS];    /* last position of every hash */
+   int prev[TDEFLATE_WINDOW_SIZE];       /* previous position of the same hash */
+   unsigned short litlen[TDEFLATE_BLOCK_TOKENS]; /* literal or match length */
+   unsigned short dist[TDEFLATE_BLOCK_TOKENS];   /* 0 for literals */
+} TDEFLATE_STATE;
+
+/* upper bound of the compressed size of sourceLen bytes */
+unsigned int tdeflate_bound(unsigned int sourceLen);
+
+/* compress source into a zlib stream of at most destCapacity bytes,
+   returns TDEFLATE_OK with *destLen set, or TDEFLATE_BUF_ERROR */
+int tdeflate_zlib_compress(TDEFLATE_STATE *s, void *dest, unsigned int destCapacity, unsigned int *destLen,
+                           const void *source, unsigned int sourceLen, int level);
+
+#endif /* TDEFLATE_H_INCLUDED */
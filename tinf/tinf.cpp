@@ -31,24 +31,25 @@
  *    any source distribution.
  */
 
+#include <string.h>
+#include <limits.h>
+
 #include "tinf.h"
 
 /* ------------------------------ *
  * -- internal data structures -- *
  * ------------------------------ */
 
-typedef struct {
-   unsigned short table[16];  /* table of code length counts */
-   unsigned short trans[288]; /* code -> symbol translation table */
-} TINF_TREE;
-
 typedef struct {
    const unsigned char *source;
+   const unsigned char *source_end;
    unsigned int tag;
    unsigned int bitcount;
+   int overflow; /* set once reading past source_end */
 
+   unsigned char *dest_start;
    unsigned char *dest;
-   unsigned int *destLen;
+   unsigned int dest_left; /* room left in dest */
 
    TINF_TREE ltree; /* dynamic length/symbol tree */
    TINF_TREE dtree; /* dynamic distance tree */
@@ -123,10 +124,11 @@ static void tinf_build_fixed_trees(TINF_TREE *lt, TINF_TREE *dt)
 }
 
 /* given an array of code lengths, build a tree */
-static void tinf_build_tree(TINF_TREE *t, const unsigned char *lengths, unsigned int num)
+static int tinf_build_tree(TINF_TREE *t, const unsigned char *lengths, unsigned int num)
 {
    unsigned short offs[16];
    unsigned int i, sum;
+   int left;
 
    /* clear code length count table */
    for (i = 0; i < 16; ++i) t->table[i] = 0;
@@ -136,6 +138,13 @@ static void tinf_build_tree(TINF_TREE *t, const unsigned char *lengths, unsigned
 
    t->table[0] = 0;
 
+   /* reject over-subscribed code lengths, incomplete codes fail when decoded */
+   for (left = 1, i = 1; i < 16; ++i)
+   {
+      left = 2*left - t->table[i];
+      if (left < 0) return TINF_DATA_ERROR;
+   }
+
    /* compute offset table for distribution sort */
    for (sum = 0, i = 0; i < 16; ++i)
    {
@@ -148,6 +157,8 @@ static void tinf_build_tree(TINF_TREE *t, const unsigned char *lengths, unsigned
    {
       if (lengths[i]) t->trans[offs[lengths[i]]++] = i;
    }
+
+   return TINF_OK;
 }
 
 /* ---------------------- *
@@ -162,8 +173,14 @@ static int tinf_getbit(TINF_DATA *d)
    /* check if tag is empty */
    if (!d->bitcount--)
    {
-      /* load next tag */
-      d->tag = *d->source++;
+      /* load next tag, past the end of source read zeros */
+      if (d->source == d->source_end)
+      {
+         d->overflow = 1;
+         d->tag = 0;
+      } else {
+         d->tag = *d->source++;
+      }
       d->bitcount = 7;
    }
 
@@ -192,7 +209,7 @@ static unsigned int tinf_read_bits(TINF_DATA *d, int num, int base)
    return val + base;
 }
 
-/* given a data stream and a tree, decode a symbol */
+/* given a data stream and a tree, decode a symbol, -1 for an invalid code */
 static int tinf_decode_symbol(TINF_DATA *d, TINF_TREE *t)
 {
    int sum = 0, cur = 0, len = 0;
@@ -202,7 +219,7 @@ static int tinf_decode_symbol(TINF_DATA *d, TINF_TREE *t)
 
       cur = 2*cur + tinf_getbit(d);
 
-      ++len;
+      if (++len > 15) return -1;
 
       sum += t->table[len];
       cur -= t->table[len];
@@ -213,7 +230,7 @@ static int tinf_decode_symbol(TINF_DATA *d, TINF_TREE *t)
 }
 
 /* given a data stream, decode dynamic trees from it */
-static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
+static int tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 {
    TINF_TREE code_tree;
    unsigned char lengths[288+32];
@@ -229,6 +246,8 @@ static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
    /* get 4 bits HCLEN (4-19) */
    hclen = tinf_read_bits(d, 4, 4);
 
+   if (hlit > 286 || hdist > 30) return TINF_DATA_ERROR;
+
    for (i = 0; i < 19; ++i) lengths[i] = 0;
 
    /* read code lengths for code length alphabet */
@@ -241,49 +260,101 @@ static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
    }
 
    /* build code length tree */
-   tinf_build_tree(&code_tree, lengths, 19);
+   if (tinf_build_tree(&code_tree, lengths, 19) != TINF_OK) return TINF_DATA_ERROR;
 
    /* decode code lengths for the dynamic trees */
    for (num = 0; num < hlit + hdist; )
    {
       int sym = tinf_decode_symbol(d, &code_tree);
+      unsigned char repeated = 0;
+
+      if (d->overflow) return TINF_SOURCE_ERROR;
 
       switch (sym)
       {
       case 16:
          /* copy previous code length 3-6 times (read 2 bits) */
-         {
-            unsigned char prev = lengths[num - 1];
-            for (length = tinf_read_bits(d, 2, 3); length; --length)
-            {
-               lengths[num++] = prev;
-            }
-         }
+         if (num == 0) return TINF_DATA_ERROR;
+         repeated = lengths[num - 1];
+         length = tinf_read_bits(d, 2, 3);
          break;
       case 17:
          /* repeat code length 0 for 3-10 times (read 3 bits) */
-         for (length = tinf_read_bits(d, 3, 3); length; --length)
-         {
-            lengths[num++] = 0;
-         }
+         length = tinf_read_bits(d, 3, 3);
          break;
       case 18:
          /* repeat code length 0 for 11-138 times (read 7 bits) */
-         for (length = tinf_read_bits(d, 7, 11); length; --length)
-         {
-            lengths[num++] = 0;
-         }
+         length = tinf_read_bits(d, 7, 11);
          break;
+      case -1:
+         return TINF_DATA_ERROR;
       default:
          /* values 0-15 represent the actual code lengths */
          lengths[num++] = sym;
-         break;
+         continue;
+      }
+
+      if (length > hlit + hdist - num) return TINF_DATA_ERROR;
+
+      for (; length; --length)
+      {
+         lengths[num++] = repeated;
       }
    }
 
    /* build dynamic trees */
-   tinf_build_tree(lt, lengths, hlit);
-   tinf_build_tree(dt, lengths + hlit, hdist);
+   if (tinf_build_tree(lt, lengths, hlit) != TINF_OK
+       || tinf_build_tree(dt, lengths + hlit, hdist) != TINF_OK) return TINF_DATA_ERROR;
+
+   return TINF_OK;
+}
+
+/* copy a match of length bytes from dist bytes back, the regions may
+ * overlap; writes up to TINF_DEST_SLACK - 1 bytes past dest + length */
+static void tinf_copy_match(unsigned char *dest, unsigned int dist, unsigned int length)
+{
+   const unsigned char *src = dest - dist;
+   unsigned char *end = dest + length;
+
+   if (dist == 1)
+   {
+      /* run of a single byte */
+      memset(dest, *src, length);
+   }
+   else if (dist < 8)
+   {
+      /* replicate the pattern into 8 bytes, store it in steps of the
+         largest multiple of dist not above 8 to keep it in phase */
+      unsigned char pattern[8];
+      unsigned int i, step = 8 - 8 % dist;
+
+      for (i = 0; i < 8; ++i) pattern[i] = src[i % dist];
+
+      for (; dest < end; dest += step) memcpy(dest, pattern, 8);
+   }
+   else if (dist < 16)
+   {
+      /* chunks never reach past the start of their destination */
+      for (; dest < end; dest += 8, src += 8) memcpy(dest, src, 8);
+   }
+   else
+   {
+      for (; dest < end; dest += 16, src += 16) memcpy(dest, src, 16);
+   }
+}
+
+/* copy a match into dest which has room for dest_left bytes,
+ * wide stores are used when there is room for their overshoot */
+static void tinf_write_match(unsigned char *dest, unsigned int dest_left, unsigned int dist, unsigned int length)
+{
+   if (dest_left - length >= TINF_DEST_SLACK)
+   {
+      tinf_copy_match(dest, dist, length);
+   } else {
+      const unsigned char *src = dest - dist;
+      unsigned int i;
+      for (i = 0; i < length; ++i) dest[i] = src[i];
+   }
 }
 
 /* ----------------------------- *
@@ -293,46 +364,68 @@ static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 /* given a stream and two trees, inflate a block of data */
 static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 {
-   /* remember current output position */
-   unsigned char *start = d->dest;
-
    while (1)
    {
       int sym = tinf_decode_symbol(d, lt);
 
+      if (d->overflow) return TINF_SOURCE_ERROR;
+
       /* check for end of block */
       if (sym == 256)
       {
-         *d->destLen += d->dest - start;
          return TINF_OK;
       }
 
+      if (sym < 0) return TINF_DATA_ERROR;
+
       if (sym < 256)
       {
-         *d->dest++ = sym;
+         /* literal run */
+         do {
+            if (!d->dest_left) return TINF_BUF_ERROR;
+            *d->dest++ = sym;
+            d->dest_left--;
+            sym = tinf_decode_symbol(d, lt);
+            if (d->overflow) return TINF_SOURCE_ERROR;
+         } while (sym >= 0 && sym < 256);
+
+         if (sym == 256)
+         {
+            return TINF_OK;
+         }
 
-      } else {
+         if (sym < 0) return TINF_DATA_ERROR;
+      }
 
-         int length, dist, offs;
-         int i;
+      {
+         unsigned int length, offs;
+         int dist;
 
          sym -= 257;
 
+         if (sym > 28) return TINF_DATA_ERROR;
+
          /* possibly get more bits from length code */
          length = tinf_read_bits(d, length_bits[sym], length_base[sym]);
 
          dist = tinf_decode_symbol(d, dt);
 
+         if (dist < 0 || dist > 29) return d->overflow ? TINF_SOURCE_ERROR : TINF_DATA_ERROR;
+
          /* possibly get more bits from distance code */
          offs = tinf_read_bits(d, dist_bits[dist], dist_base[dist]);
 
+         if (d->overflow) return TINF_SOURCE_ERROR;
+
+         if (offs > (unsigned int)(d->dest - d->dest_start)) return TINF_DIST_ERROR;
+
+         if (length > d->dest_left) return TINF_BUF_ERROR;
+
          /* copy match */
-         for (i = 0; i < length; ++i)
-         {
-            d->dest[i] = d->dest[i - offs];
-         }
+         tinf_write_match(d->dest, d->dest_left, offs, length);
 
          d->dest += length;
+         d->dest_left -= length;
       }
    }
 }
@@ -341,7 +434,8 @@ static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 static int tinf_inflate_uncompressed_block(TINF_DATA *d)
 {
    unsigned int length, invlength;
-   unsigned int i;
+
+   if (d->source_end - d->source < 4) return TINF_SOURCE_ERROR;
 
    /* get length */
    length = d->source[1];
@@ -356,14 +450,19 @@ static int tinf_inflate_uncompressed_block(TINF_DATA *d)
 
    d->source += 4;
 
+   if (length > (unsigned int)(d->source_end - d->source)) return TINF_SOURCE_ERROR;
+
+   if (length > d->dest_left) return TINF_BUF_ERROR;
+
    /* copy block */
-   for (i = length; i; --i) *d->dest++ = *d->source++;
+   memcpy(d->dest, d->source, length);
+   d->dest += length;
+   d->dest_left -= length;
+   d->source += length;
 
    /* make sure we start next block on a byte boundary */
    d->bitcount = 0;
 
-   *d->destLen += length;
-
    return TINF_OK;
 }
 
@@ -378,7 +477,9 @@ static int tinf_inflate_fixed_block(TINF_DATA *d)
 static int tinf_inflate_dynamic_block(TINF_DATA *d)
 {
    /* decode trees from stream */
-   tinf_decode_trees(d, &d->ltree, &d->dtree);
+   int res = tinf_decode_trees(d, &d->ltree, &d->dtree);
+
+   if (res != TINF_OK) return res;
 
    /* decode block using decoded trees */
    return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
@@ -403,26 +504,34 @@ void tinf_init()
    length_base[28] = 258;
 }
 
-/* inflate stream from source to dest */
+/* inflate stream from source to dest, dest must be large enough
+ * for the output plus TINF_DEST_SLACK */
 int tinf_uncompress(void *dest, unsigned int *destLen,
                     const void *source, unsigned int sourceLen)
+{
+   return tinf_uncompress_bounded(dest, UINT_MAX, destLen, source, sourceLen);
+}
+
+/* inflate stream from source to dest, checking every read and write */
+int tinf_uncompress_bounded(void *dest, unsigned int destCapacity, unsigned int *destLen,
+                            const void *source, unsigned int sourceLen)
 {
    TINF_DATA d;
-   int bfinal;
+   int bfinal, res = TINF_OK;
 
    /* initialise data */
    d.source = (const unsigned char *)source;
+   d.source_end = d.source + sourceLen;
    d.bitcount = 0;
+   d.overflow = 0;
 
+   d.dest_start = (unsigned char *)dest;
    d.dest = (unsigned char *)dest;
-   d.destLen = destLen;
-
-   *destLen = 0;
+   d.dest_left = destCapacity;
 
    do {
 
       unsigned int btype;
-      int res;
 
       /* read final block flag */
       bfinal = tinf_getbit(&d);
@@ -430,6 +539,12 @@ int tinf_uncompress(void *dest, unsigned int *destLen,
       /* read block type (2 bits) */
       btype = tinf_read_bits(&d, 2, 0);
 
+      if (d.overflow)
+      {
+         res = TINF_SOURCE_ERROR;
+         break;
+      }
+
       /* decompress block */
       switch (btype)
       {
@@ -446,12 +561,300 @@ int tinf_uncompress(void *dest, unsigned int *destLen,
          res = tinf_inflate_dynamic_block(&d);
          break;
       default:
-         return TINF_DATA_ERROR;
+         res = TINF_DATA_ERROR;
       }
 
-      if (res != TINF_OK) return TINF_DATA_ERROR;
+   } while (res == TINF_OK && !bfinal);
 
-   } while (!bfinal);
+   *destLen = d.dest - d.dest_start;
 
-   return TINF_OK;
+   return res;
+}
+
+/* ------------------------ *
+ * -- resumable inflate  -- *
+ * ------------------------ */
+
+enum {
+   TINF_STATE_ZLIB_HEADER,
+   TINF_STATE_BLOCK_HEADER,
+   TINF_STATE_STORED_LENGTH,
+   TINF_STATE_STORED_COPY,
+   TINF_STATE_TREE_COUNTS,
+   TINF_STATE_CODE_LENGTHS,
+   TINF_STATE_TREE_LENGTHS,
+   TINF_STATE_TREE_REPEAT,
+   TINF_STATE_SYMBOL,
+   TINF_STATE_LENGTH_BITS,
+   TINF_STATE_DISTANCE,
+   TINF_STATE_DISTANCE_BITS,
+   TINF_STATE_ZLIB_TRAILER,
+   TINF_STATE_DONE
+};
+
+/* move input bytes into the bit buffer until it holds num bits */
+static int tinf_stream_need(TINF_STREAM *s, const unsigned char **in, const unsigned char *in_end, unsigned int num)
+{
+   while (s->bitcount < num && *in < in_end)
+   {
+      s->bitbuf |= (unsigned long long)*(*in)++ << s->bitcount;
+      s->bitcount += 8;
+   }
+
+   return s->bitcount >= num;
+}
+
+static unsigned int tinf_stream_bits(TINF_STREAM *s, unsigned int num)
+{
+   unsigned int val = (unsigned int)(s->bitbuf & ((1ull << num) - 1));
+
+   s->bitbuf >>= num;
+   s->bitcount -= num;
+
+   return val;
+}
+
+/* decode a symbol from buffered bits, -1 for an invalid code,
+ * -2 if more input is needed (nothing is consumed then) */
+static int tinf_stream_symbol(TINF_STREAM *s, const unsigned char **in, const unsigned char *in_end, const TINF_TREE *t)
+{
+   int sum = 0, cur = 0;
+   unsigned int len = 0;
+
+   tinf_stream_need(s, in, in_end, 15);
+
+   do {
+
+      if (len == s->bitcount) return -2;
+
+      cur = 2*cur + (int)((s->bitbuf >> len) & 1);
+
+      if (++len > 15) return -1;
+
+      sum += t->table[len];
+      cur -= t->table[len];
+
+   } while (cur >= 0);
+
+   tinf_stream_bits(s, len);
+
+   return t->trans[sum + cur];
+}
+
+void tinf_stream_init(TINF_STREAM *s, void *dest, unsigned int destCapacity, int zlib)
+{
+   s->state = zlib ? TINF_STATE_ZLIB_HEADER : TINF_STATE_BLOCK_HEADER;
+   s->zlib = zlib;
+   s->bfinal = 0;
+   s->fixed = 0;
+   s->bitbuf = 0;
+   s->bitcount = 0;
+   s->dest_start = (unsigned char *)dest;
+   s->dest_left = destCapacity;
+   s->destLen = 0;
+}
+
+int tinf_stream_inflate(TINF_STREAM *s, const void *source, unsigned int sourceLen, unsigned int *consumed)
+{
+   const unsigned char *in = (const unsigned char *)source;
+   const unsigned char *in_end = in + sourceLen;
+   unsigned char *dest = s->dest_start + s->destLen;
+   int res = TINF_NEED_INPUT;
+
+#define TINF_NEED(num) if (!tinf_stream_need(s, &in, in_end, (num))) goto suspend
+
+   for (;;)
+   {
+      switch (s->state)
+      {
+      case TINF_STATE_ZLIB_HEADER:
+      {
+         unsigned int cmf, flg;
+         TINF_NEED(16);
+         cmf = tinf_stream_bits(s, 8);
+         flg = tinf_stream_bits(s, 8);
+         if ((cmf & 0x0f) != 8 || (cmf * 256 + flg) % 31 != 0 || (flg & 0x20)) { res = TINF_DATA_ERROR; goto suspend; }
+         s->state = TINF_STATE_BLOCK_HEADER;
+         break;
+      }
+      case TINF_STATE_BLOCK_HEADER:
+      {
+         unsigned int btype;
+         if (s->bfinal)
+         {
+            /* past the final block, skip to the byte boundary */
+            tinf_stream_bits(s, s->bitcount % 8);
+            s->state = s->zlib ? TINF_STATE_ZLIB_TRAILER : TINF_STATE_DONE;
+            break;
+         }
+         TINF_NEED(3);
+         s->bfinal = tinf_stream_bits(s, 1);
+         btype = tinf_stream_bits(s, 2);
+         if (btype == 0)
+         {
+            tinf_stream_bits(s, s->bitcount % 8);
+            s->state = TINF_STATE_STORED_LENGTH;
+         } else if (btype == 1) {
+            s->fixed = 1;
+            s->state = TINF_STATE_SYMBOL;
+         } else if (btype == 2) {
+            s->fixed = 0;
+            s->state = TINF_STATE_TREE_COUNTS;
+         } else {
+            res = TINF_DATA_ERROR;
+            goto suspend;
+         }
+         break;
+      }
+      case TINF_STATE_STORED_LENGTH:
+      {
+         unsigned int length, invlength;
+         TINF_NEED(32);
+         length = tinf_stream_bits(s, 16);
+         invlength = tinf_stream_bits(s, 16);
+         if (length != (~invlength & 0x0000ffff)) { res = TINF_DATA_ERROR; goto suspend; }
+         if (length > s->dest_left) { res = TINF_BUF_ERROR; goto suspend; }
+         s->length = length;
+         s->state = TINF_STATE_STORED_COPY;
+         break;
+      }
+      case TINF_STATE_STORED_COPY:
+      {
+         unsigned int chunk;
+         /* whole bytes still in the bit buffer come first */
+         while (s->length && s->bitcount >= 8)
+         {
+            *dest++ = (unsigned char)tinf_stream_bits(s, 8);
+            s->dest_left--;
+            s->length--;
+         }
+         chunk = (unsigned int)(in_end - in) < s->length ? (unsigned int)(in_end - in) : s->length;
+         memcpy(dest, in, chunk);
+         dest += chunk;
+         in += chunk;
+         s->dest_left -= chunk;
+         s->length -= chunk;
+         if (s->length) goto suspend;
+         s->state = TINF_STATE_BLOCK_HEADER;
+         break;
+      }
+      case TINF_STATE_TREE_COUNTS:
+         TINF_NEED(14);
+         s->hlit = tinf_stream_bits(s, 5) + 257;
+         s->hdist = tinf_stream_bits(s, 5) + 1;
+         s->hclen = tinf_stream_bits(s, 4) + 4;
+         if (s->hlit > 286 || s->hdist > 30) { res = TINF_DATA_ERROR; goto suspend; }
+         memset(s->lengths, 0, 19);
+         s->num = 0;
+         s->state = TINF_STATE_CODE_LENGTHS;
+         break;
+      case TINF_STATE_CODE_LENGTHS:
+         while (s->num < s->hclen)
+         {
+            TINF_NEED(3);
+            s->lengths[clcidx[s->num++]] = tinf_stream_bits(s, 3);
+         }
+         if (tinf_build_tree(&s->ctree, s->lengths, 19) != TINF_OK) { res = TINF_DATA_ERROR; goto suspend; }
+         s->num = 0;
+         s->state = TINF_STATE_TREE_LENGTHS;
+         break;
+      case TINF_STATE_TREE_LENGTHS:
+         while (s->num < s->hlit + s->hdist)
+         {
+            int sym = tinf_stream_symbol(s, &in, in_end, &s->ctree);
+            if (sym == -2) goto suspend;
+            if (sym < 0 || (sym == 16 && s->num == 0)) { res = TINF_DATA_ERROR; goto suspend; }
+            if (sym < 16)
+            {
+               s->lengths[s->num++] = sym;
+            } else {
+               s->sym = sym;
+               s->state = TINF_STATE_TREE_REPEAT;
+               break;
+            }
+         }
+         if (s->state == TINF_STATE_TREE_LENGTHS)
+         {
+            if (tinf_build_tree(&s->ltree, s->lengths, s->hlit) != TINF_OK
+                || tinf_build_tree(&s->dtree, s->lengths + s->hlit, s->hdist) != TINF_OK) { res = TINF_DATA_ERROR; goto suspend; }
+            s->state = TINF_STATE_SYMBOL;
+         }
+         break;
+      case TINF_STATE_TREE_REPEAT:
+      {
+         /* 16: previous length 3-6 times, 17: zero 3-10 times, 18: zero 11-138 times */
+         unsigned int bits = s->sym == 16 ? 2 : s->sym == 17 ? 3 : 7;
+         unsigned int base = s->sym == 18 ? 11 : 3;
+         unsigned int length;
+         unsigned char repeated = s->sym == 16 ? s->lengths[s->num - 1] : 0;
+         TINF_NEED(bits);
+         length = tinf_stream_bits(s, bits) + base;
+         if (length > s->hlit + s->hdist - s->num) { res = TINF_DATA_ERROR; goto suspend; }
+         for (; length; --length) s->lengths[s->num++] = repeated;
+         s->state = TINF_STATE_TREE_LENGTHS;
+         break;
+      }
+      case TINF_STATE_SYMBOL:
+      {
+         int sym = tinf_stream_symbol(s, &in, in_end, s->fixed ? &sltree : &s->ltree);
+         if (sym == -2) goto suspend;
+         if (sym < 0 || sym > 285) { res = TINF_DATA_ERROR; goto suspend; }
+         if (sym < 256)
+         {
+            if (!s->dest_left) { res = TINF_BUF_ERROR; goto suspend; }
+            *dest++ = sym;
+            s->dest_left--;
+         } else if (sym == 256) {
+            s->state = TINF_STATE_BLOCK_HEADER;
+         } else {
+            s->sym = sym - 257;
+            s->state = TINF_STATE_LENGTH_BITS;
+         }
+         break;
+      }
+      case TINF_STATE_LENGTH_BITS:
+         TINF_NEED(length_bits[s->sym]);
+         s->length = tinf_stream_bits(s, length_bits[s->sym]) + length_base[s->sym];
+         s->state = TINF_STATE_DISTANCE;
+         break;
+      case TINF_STATE_DISTANCE:
+      {
+         int sym = tinf_stream_symbol(s, &in, in_end, s->fixed ? &sdtree : &s->dtree);
+         if (sym == -2) goto suspend;
+         if (sym < 0 || sym > 29) { res = TINF_DATA_ERROR; goto suspend; }
+         s->sym = sym;
+         s->state = TINF_STATE_DISTANCE_BITS;
+         break;
+      }
+      case TINF_STATE_DISTANCE_BITS:
+      {
+         unsigned int offs;
+         TINF_NEED(dist_bits[s->sym]);
+         offs = tinf_stream_bits(s, dist_bits[s->sym]) + dist_base[s->sym];
+         if (offs > (unsigned int)(dest - s->dest_start)) { res = TINF_DIST_ERROR; goto suspend; }
+         if (s->length > s->dest_left) { res = TINF_BUF_ERROR; goto suspend; }
+         tinf_write_match(dest, s->dest_left, offs, s->length);
+         dest += s->length;
+         s->dest_left -= s->length;
+         s->state = TINF_STATE_SYMBOL;
+         break;
+      }
+      case TINF_STATE_ZLIB_TRAILER:
+         /* adler32 is not verified */
+         TINF_NEED(32);
+         tinf_stream_bits(s, 32);
+         s->state = TINF_STATE_DONE;
+         break;
+      case TINF_STATE_DONE:
+         res = TINF_OK;
+         goto suspend;
+      }
+   }
+
+#undef TINF_NEED
+
+suspend:
+   s->destLen = (unsigned int)(dest - s->dest_start);
+   if (consumed) *consumed = (unsigned int)(in - (const unsigned char *)source);
+   return res;
 }
@@ -10,17 +10,72 @@
  *
  * Changed by Frantisek Veverka 2018
  *  - keeping only tinf_uncompress
+ * Changed by Frantisek Veverka 2021
+ *  - wide match copies, requires TINF_DEST_SLACK
+ *  - tinf_uncompress_bounded validating all reads and writes
+ *  - resumable tinf_stream_inflate
  */
 
 #ifndef TINF_H_INCLUDED
 #define TINF_H_INCLUDED
 
 #define TINF_OK             0
-#define TINF_DATA_ERROR    (-3)
+#define TINF_NEED_INPUT     1   /* tinf_stream_inflate consumed all input */
+#define TINF_DATA_ERROR    (-3) /* invalid deflate stream */
+#define TINF_BUF_ERROR     (-5) /* output doesn't fit in destCapacity */
+#define TINF_SOURCE_ERROR  (-6) /* input ended before the final block */
+#define TINF_DIST_ERROR    (-7) /* back reference before the start of output */
+
+/* tinf_uncompress may write up to this many bytes past the end of the
+   decompressed data, dest must have room for them */
+#define TINF_DEST_SLACK    16
+
+typedef struct {
+   unsigned short table[16];  /* table of code length counts */
+   unsigned short trans[288]; /* code -> symbol translation table */
+} TINF_TREE;
+
+/* state of a resumable inflate, the output goes to one contiguous buffer
+   so back references are resolved against it and no window is kept */
+typedef struct {
+   int state;
+   int zlib;
+   int bfinal;
+   int fixed;
+   unsigned long long bitbuf;
+   unsigned int bitcount;
+
+   unsigned char *dest_start;
+   unsigned int dest_left;
+   unsigned int destLen; /* bytes written so far */
+
+   int sym;
+   unsigned int length;
+   unsigned int hlit, hdist, hclen, num;
+   unsigned char lengths[288+32];
+   TINF_TREE ctree; /* code length tree */
+   TINF_TREE ltree; /* dynamic length/symbol tree */
+   TINF_TREE dtree; /* dynamic distance tree */
+} TINF_STREAM;
 
 void tinf_init();
 
 int tinf_uncompress(void *dest, unsigned int *destLen,
                            const void *source, unsigned int sourceLen);
 
+/* never reads past source + sourceLen nor writes past dest + destCapacity,
+   no slack needed, *destLen is the number of bytes written */
+int tinf_uncompress_bounded(void *dest, unsigned int destCapacity, unsigned int *destLen,
+                            const void *source, unsigned int sourceLen);
+
+/* prepare a resumable inflate of a raw deflate stream, or of a zlib
+   stream (header and adler32, which is not verified) if zlib is nonzero */
+void tinf_stream_init(TINF_STREAM *s, void *dest, unsigned int destCapacity, int zlib);
+
+/* feed the next piece of input, returns TINF_OK once the stream ended,
+   TINF_NEED_INPUT when all of it was used, otherwise an error;
+   *consumed receives the number of bytes used */
+int tinf_stream_inflate(TINF_STREAM *s, const void *source, unsigned int sourceLen,
+                        unsigned int *consumed);
+
 #endif
@@ -0,0 +1,125 @@
+/*
+ * Generator of synthetic .aseprite files for scaling tests
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * Build from the repository root:
+ *  g++ -std=c++17 -O2 -I. -Itools tools/asegen.cpp tools/synthetic.cpp aseprite.cpp load_stats.cpp \
+ *      decoder_context.cpp decompressor.cpp tinf/tinf.cpp tinf/tdeflate.cpp -o asegen
+ *  ./asegen [options] output.aseprite
+ *
+ * Options (defaults in brackets):
+ *  --size=WxH          canvas size [256x256]
+ *  --depth=8|16|32     indexed, grayscale or RGBA [32]
+ *  --frames=N          [8]
+ *  --layers=N          [2]
+ *  --cel-density=P     chance of a layer having a cel in a frame, 0 - 1 [1]
+ *  --linked=P          chance of a cel linking to the previous cel of its layer, 0 - 1 [0]
+ *  --tags=N            loops splitting the frames evenly [0]
+ *  --slices=N          [0]
+ *  --profile=NAME      flat, pixelart, gradient or noise [pixelart]
+ *  --level=0-9         deflate level of the cels [6]
+ *  --seed=N            [1]
+ *
+ * Frames are generated and written one at a time, files are not limited by memory.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include "synthetic.h"
+
+static void usage() {
+    std::printf("usage: asegen [--size=WxH] [--depth=8|16|32] [--frames=N] [--layers=N] [--cel-density=P]\n"
+                "              [--linked=P] [--tags=N] [--slices=N] [--profile=flat|pixelart|gradient|noise]\n"
+                "              [--level=0-9] [--seed=N] output.aseprite\n");
+}
+
+// value of --name=value or nullptr
+static const char * option(const char * arg, const char * name) {
+    size_t length = std::strlen(name);
+    if (std::strncmp(arg, name, length) == 0 && arg[length] == '=') {
+        return arg + length + 1;
+    }
+    return nullptr;
+}
+
+int main(int argc, char ** argv) {
+    synthetic::SpriteSpec spec;
+    int level = TDEFLATE_DEFAULT_LEVEL;
+    std::string output;
+
+    for (int i = 1; i < argc; i++) {
+        const char * arg = argv[i];
+        const char * value;
+        if ((value = option(arg, "--size"))) {
+            unsigned width, height;
+            if (std::sscanf(value, "%ux%u", &width, &height) != 2 || !width || !height || width > 65535 || height > 65535) {
+                std::printf("bad size %s\n", value);
+                return 1;
+            }
+            spec.width = width;
+            spec.height = height;
+        } else if ((value = option(arg, "--depth"))) {
+            int depth = std::atoi(value);
+            if (depth != 8 && depth != 16 && depth != 32) {
+                std::printf("bad depth %s\n", value);
+                return 1;
+            }
+            spec.format = depth == 8 ? aseprite::INDEXED : depth == 16 ? aseprite::GRAYSCALE : aseprite::RGBA;
+        } else if ((value = option(arg, "--frames"))) {
+            spec.frames = std::atoi(value);
+        } else if ((value = option(arg, "--layers"))) {
+            spec.layers = std::atoi(value);
+        } else if ((value = option(arg, "--cel-density"))) {
+            spec.celDensity = std::atof(value);
+        } else if ((value = option(arg, "--linked"))) {
+            spec.linkedRatio = std::atof(value);
+        } else if ((value = option(arg, "--tags"))) {
+            spec.tags = std::atoi(value);
+        } else if ((value = option(arg, "--slices"))) {
+            spec.slices = std::atoi(value);
+        } else if ((value = option(arg, "--profile"))) {
+            std::string profile = value;
+            if (profile == "flat") {
+                spec.profile = synthetic::Profile::FLAT;
+            } else if (profile == "pixelart") {
+                spec.profile = synthetic::Profile::PIXEL_ART;
+            } else if (profile == "gradient") {
+                spec.profile = synthetic::Profile::GRADIENT;
+            } else if (profile == "noise") {
+                spec.profile = synthetic::Profile::NOISE;
+            } else {
+                std::printf("bad profile %s\n", value);
+                return 1;
+            }
+        } else if ((value = option(arg, "--level"))) {
+            level = std::atoi(value);
+        } else if ((value = option(arg, "--seed"))) {
+            spec.seed = std::strtoul(value, nullptr, 10);
+        } else if (arg[0] == '-') {
+            usage();
+            return 1;
+        } else {
+            output = arg;
+        }
+    }
+    if (output.empty()) {
+        usage();
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t size = synthetic::writeSprite(spec, output, level);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!size) {
+        std::printf("can't write %s\n", output.c_str());
+        return 1;
+    }
+    std::printf("%s: %llu bytes, %ux%u, %u frames x %u layers, %.2f s\n", output.c_str(),
+        (unsigned long long) size, spec.width, spec.height, spec.frames, spec.layers, seconds);
+    return 0;
+}
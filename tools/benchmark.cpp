@@ -0,0 +1,414 @@
+/*
+ * Benchmarks of the loading stages: parsing, inflate, conversion, substitution, expansion, blitting, batch
+ * rendering and lookups
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * Build from the repository root:
+ *  g++ -std=c++17 -O2 -I. -Itools tools/benchmark.cpp tools/synthetic.cpp aseprite.cpp aseprite_to_animation.cpp \
+ *      collision_mask.cpp image_expand.cpp rle_image.cpp sprite_batch.cpp thread_pool.cpp decompressor.cpp \
+ *      decoder_context.cpp load_stats.cpp tinf/tinf.cpp tinf/tdeflate.cpp -pthread -o benchmark
+ *  ./benchmark [--benchmark_filter=substring] [--benchmark_min_time=seconds] [file.aseprite ...]
+ *
+ * Every benchmark reports time per iteration, throughput (bytes of its input or output, per second),
+ * items per second and heap allocations per iteration, counted by the operator new below.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include "aseprite.h"
+#include "aseprite_to_animation.h"
+#include "decompressor.h"
+#include "sprite_batch.h"
+#include "synthetic.h"
+
+// the replaced operator new allocates with malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<uint64_t> allocations{0};
+static std::atomic<uint64_t> allocatedBytes{0};
+
+void * operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void * p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * Passed to a benchmark, which runs its setup and then loops while keepRunning().
+ * Only the loop is timed.
+ */
+class State {
+    uint64_t remaining;
+    Clock::time_point start;
+    uint64_t startAllocations = 0;
+    uint64_t startBytes = 0;
+
+public:
+    const uint64_t iterations;
+    uint64_t bytesPerIteration = 0;
+    uint64_t itemsPerIteration = 0;
+    bool failed = false;
+
+    double seconds = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+
+    explicit State(uint64_t iterations) :
+        remaining(iterations),
+        iterations(iterations) {
+    }
+
+    bool keepRunning() {
+        if (remaining == iterations) {
+            startAllocations = ::allocations.load(std::memory_order_relaxed);
+            startBytes = ::allocatedBytes.load(std::memory_order_relaxed);
+            start = Clock::now();
+        }
+        if (remaining-- > 0) {
+            return true;
+        }
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        allocations = ::allocations.load(std::memory_order_relaxed) - startAllocations;
+        allocatedBytes = ::allocatedBytes.load(std::memory_order_relaxed) - startBytes;
+        return false;
+    }
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void(State &)> run;
+};
+
+// keeps the optimizer from dropping results
+template <typename T>
+void doNotOptimize(const T & value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// passes the streams through to tinf and keeps a copy of each of them
+class RecordingDecompressor : public aseprite::Decompressor {
+public:
+    struct Stream {
+        std::vector<uint8_t> compressed;
+        uint32_t uncompressedLen;
+    };
+    mutable std::vector<Stream> streams;
+
+    using Decompressor::uncompress;
+
+    const char * name() const override {
+        return "recording";
+    }
+
+    bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                    const uint8_t * source, uint32_t sourceLen) const override {
+        bool result = aseprite::defaultDecompressor().uncompress(dest, destCapacity, destLen, source, sourceLen);
+        if (result) {
+            streams.push_back(Stream{std::vector<uint8_t>(source, source + sourceLen), destLen});
+        }
+        return result;
+    }
+};
+
+size_t fileSize(const std::string & path) {
+    std::error_code error;
+    auto size = std::filesystem::file_size(path, error);
+    return error ? 0 : size;
+}
+
+void addFileBenchmarks(std::vector<Benchmark> & benchmarks, const std::string & label, const std::string & path) {
+    const size_t size = fileSize(path);
+
+    benchmarks.push_back({"ASE_HEADER::read/" + label, [path](State & state) {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        aseprite::ASE_HEADER header;
+        state.bytesPerIteration = sizeof(header);
+        while (state.keepRunning()) {
+            file.seekg(0);
+            state.failed |= !header.read(file);
+            doNotOptimize(header);
+        }
+    }});
+
+    benchmarks.push_back({"FRAME::read/" + label, [path, size](State & state) {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        aseprite::ASEPRITE ase;
+        state.failed = !ase.header.read(file);
+        const auto framesStart = file.tellg();
+        state.bytesPerIteration = size;
+        state.itemsPerIteration = ase.header.frames;
+        while (state.keepRunning()) {
+            file.clear();
+            file.seekg(framesStart);
+            for (size_t f = 0; f < ase.header.frames; f++) {
+                aseprite::FRAME frame;
+                state.failed |= !frame.read(file, ase.header.pixelFormat(), ase);
+                doNotOptimize(frame.chunks.size());
+            }
+        }
+    }});
+
+    benchmarks.push_back({"tinf_uncompress/" + label, [path](State & state) {
+        RecordingDecompressor recording;
+        aseprite::ASEPRITE ase(path, recording);
+        uint32_t capacity = 0;
+        for (const auto & stream : recording.streams) {
+            state.bytesPerIteration += stream.uncompressedLen;
+            capacity = std::max(capacity, stream.uncompressedLen);
+        }
+        state.itemsPerIteration = recording.streams.size();
+        std::vector<uint8_t> dest(capacity + TINF_DEST_SLACK);
+        while (state.keepRunning()) {
+            for (const auto & stream : recording.streams) {
+                // raw deflate data between the zlib header and adler32
+                unsigned int destLen;
+                state.failed |= tinf_uncompress(dest.data(), &destLen,
+                    stream.compressed.data() + 2, stream.compressed.size() - 6) != TINF_OK;
+            }
+            doNotOptimize(dest[0]);
+        }
+    }});
+
+    benchmarks.push_back({"fromASEPRITE/" + label, [path](State & state) {
+        aseprite::ASEPRITE ase(path);
+        for (const auto & frame : ase.frames) {
+            for (const auto & chunk : frame.chunks) {
+                if (chunk.type == aseprite::CEL_0x2005) {
+                    state.bytesPerIteration += std::get<aseprite::CEL_CHUNK>(chunk.data).pixels.size();
+                    state.itemsPerIteration++;
+                }
+            }
+        }
+        while (state.keepRunning()) {
+            auto animation = fromASEPRITE(ase);
+            doNotOptimize(animation.images.size());
+        }
+    }});
+
+    benchmarks.push_back({"Image::substitute/" + label, [path](State & state) {
+        auto animation = animation::Animation::loadAseImage(path);
+        for (const auto & image : animation.images) {
+            state.bytesPerIteration += image.pixels.size() * sizeof(animation::Color);
+        }
+        state.itemsPerIteration = animation.images.size();
+        while (state.keepRunning()) {
+            for (const auto & image : animation.images) {
+                auto colors = image.substitute(animation.palette, 255, animation.transparentIndex);
+                doNotOptimize(colors.data());
+            }
+        }
+    }});
+
+    benchmarks.push_back({"Image::expand/" + label, [path](State & state) {
+        auto animation = animation::Animation::loadAseImage(path);
+        size_t largest = 0;
+        for (const auto & image : animation.images) {
+            state.bytesPerIteration += image.pixels.size() * 4;
+            largest = std::max(largest, image.pixels.size());
+        }
+        state.itemsPerIteration = animation.images.size();
+        std::vector<uint32_t> staging(largest);
+        const animation::PaletteLookup lookup(animation.palette, animation::PixelLayout::RGBA8, 255, animation.transparentIndex);
+        while (state.keepRunning()) {
+            for (const auto & image : animation.images) {
+                image.expand(lookup, staging.data(), image.width * 4);
+                doNotOptimize(staging.data());
+            }
+        }
+    }});
+
+    benchmarks.push_back({"RleImage::blit/" + label, [path](State & state) {
+        animation::LoadOptions options;
+        options.rleImages = true;
+        auto animation = animation::Animation::loadAseImage(path, options);
+        size_t largest = 0;
+        for (const auto & rle : animation.rleImages) {
+            state.bytesPerIteration += rle.opaquePixels() * 4;
+            largest = std::max(largest, size_t(rle.width) * rle.height);
+        }
+        state.itemsPerIteration = animation.rleImages.size();
+        std::vector<uint32_t> staging(largest);
+        const animation::PaletteLookup lookup(animation.palette, animation::PixelLayout::RGBA8, 255, animation.transparentIndex);
+        while (state.keepRunning()) {
+            for (const auto & rle : animation.rleImages) {
+                rle.blit(lookup, staging.data(), rle.width * 4, rle.width, rle.height, 0, 0);
+                doNotOptimize(staging.data());
+            }
+        }
+    }});
+
+    benchmarks.push_back({"SpriteBatchRenderer/" + label, [path](State & state) {
+        animation::LoadOptions options;
+        options.rleImages = true;
+        auto animation = animation::Animation::loadAseImage(path, options);
+        constexpr uint32_t SIZE = 512;
+        constexpr uint32_t DRAWS = 1000;
+        std::vector<animation::SpriteDraw> draws;
+        for (uint32_t i = 0; i < DRAWS; i++) {
+            // scattered over the target, some partly outside
+            int32_t x = i * 7919 % (SIZE + animation.width) - animation.width / 2;
+            int32_t y = i * 104729 % (SIZE + animation.height) - animation.height / 2;
+            draws.push_back(animation::SpriteDraw{&animation, i % std::max<uint32_t>(1, animation.framesCount), x, y});
+        }
+        std::vector<uint32_t> target(SIZE * SIZE);
+        state.bytesPerIteration = target.size() * sizeof(uint32_t);
+        state.itemsPerIteration = DRAWS;
+        animation::ThreadPool pool;
+        animation::SpriteBatchRenderer renderer(pool);
+        while (state.keepRunning()) {
+            renderer.render(draws, target.data(), SIZE, SIZE, SIZE * sizeof(uint32_t));
+            doNotOptimize(target.data());
+        }
+    }});
+
+    benchmarks.push_back({"getLayerId(string)/" + label, [path](State & state) {
+        auto animation = animation::Animation::loadAseImage(path);
+        std::vector<std::string> names;
+        for (const auto & layer : animation.layers) {
+            names.push_back(layer.name);
+        }
+        state.itemsPerIteration = names.size();
+        while (state.keepRunning()) {
+            for (const auto & name : names) {
+                doNotOptimize(animation.getLayerId(name));
+            }
+        }
+    }});
+
+    benchmarks.push_back({"getLayerId(NameHandle)/" + label, [path](State & state) {
+        auto animation = animation::Animation::loadAseImage(path);
+        std::vector<animation::NameHandle> names;
+        for (const auto & layer : animation.layers) {
+            names.push_back(animation.getName(layer.name));
+        }
+        state.itemsPerIteration = names.size();
+        while (state.keepRunning()) {
+            for (auto name : names) {
+                doNotOptimize(animation.getLayerId(name));
+            }
+        }
+    }});
+}
+
+State run(const Benchmark & benchmark, double minTime) {
+    uint64_t iterations = 1;
+    for (;;) {
+        State state(iterations);
+        benchmark.run(state);
+        if (state.seconds >= minTime || iterations >= 1000000000 || state.failed) {
+            return state;
+        }
+        // aim past minTime in one more run, at most 10x more iterations at a time
+        double factor = state.seconds > 0 ? minTime * 1.4 / state.seconds : 10;
+        iterations = std::max<uint64_t>(iterations + 1, iterations * std::min(factor, 10.0));
+    }
+}
+
+void report(const Benchmark & benchmark, const State & state) {
+    double perIteration = state.seconds / state.iterations;
+    std::printf("%-56s %12.0f ns %10llu", benchmark.name.c_str(), perIteration * 1e9,
+        (unsigned long long) state.iterations);
+    if (state.bytesPerIteration) {
+        std::printf(" %10.1f MB/s", state.bytesPerIteration / perIteration / 1e6);
+    } else {
+        std::printf(" %15s", "");
+    }
+    if (state.itemsPerIteration) {
+        std::printf(" %12.3g items/s", state.itemsPerIteration / perIteration);
+    } else {
+        std::printf(" %20s", "");
+    }
+    std::printf(" %10.1f allocs %12.0f B%s\n",
+        double(state.allocations) / state.iterations,
+        double(state.allocatedBytes) / state.iterations,
+        state.failed ? "  FAILED" : "");
+}
+
+}
+
+int main(int argc, char ** argv) {
+    std::string filter;
+    double minTime = 0.5;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--benchmark_filter=", 0) == 0) {
+            filter = arg.substr(std::strlen("--benchmark_filter="));
+        } else if (arg.rfind("--benchmark_min_time=", 0) == 0) {
+            minTime = std::atof(arg.c_str() + std::strlen("--benchmark_min_time="));
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        files = {"mountain.aseprite", "pinkja_anim.aseprite"};
+    }
+
+    std::vector<Benchmark> benchmarks;
+    for (const auto & file : files) {
+        addFileBenchmarks(benchmarks, std::filesystem::path(file).filename().string(), file);
+    }
+
+    // synthetic sprites are written to the temp directory and go through the same stages
+    const synthetic::SpriteSpec specs[] = {
+        {.width = 256, .height = 256, .format = aseprite::RGBA, .frames = 16, .layers = 4},
+        {.width = 256, .height = 256, .format = aseprite::INDEXED, .frames = 16, .layers = 4},
+        {.width = 1024, .height = 1024, .format = aseprite::RGBA, .frames = 4, .layers = 2},
+        {.width = 1024, .height = 1024, .format = aseprite::INDEXED, .frames = 4, .layers = 2},
+    };
+    std::vector<std::string> temporaries;
+    for (const auto & spec : specs) {
+        std::string label = "synthetic_" + std::to_string(spec.width) + "x" + std::to_string(spec.height)
+            + (spec.format == aseprite::RGBA ? "_rgba" : "_indexed")
+            + "_f" + std::to_string(spec.frames) + "_l" + std::to_string(spec.layers);
+        std::string path = (std::filesystem::temp_directory_path() / (label + ".aseprite")).string();
+        if (!synthetic::makeSprite(spec).write(path, TDEFLATE_DEFAULT_LEVEL)) {
+            std::printf("%-56s can't write %s\n", label.c_str(), path.c_str());
+            continue;
+        }
+        temporaries.push_back(path);
+        addFileBenchmarks(benchmarks, label, path);
+    }
+
+    std::printf("%-56s %15s %10s %15s %20s %10s %14s\n",
+        "Benchmark", "Time", "Iterations", "Throughput", "Items", "Allocs", "Allocated");
+    for (const auto & benchmark : benchmarks) {
+        if (benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        report(benchmark, run(benchmark, minTime));
+    }
+
+    for (const auto & path : temporaries) {
+        std::remove(path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Throughput of the cel decompression backends
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ * Build from the repository root, drop the defines of missing libraries:
+ *  g++ -std=c++17 -O2 -DASEPRITE_WITH_ZLIB -DASEPRITE_WITH_LIBDEFLATE -I. tools/decompress_bench.cpp \
+ *      aseprite.cpp load_stats.cpp decoder_context.cpp decompressor.cpp tinf/tinf.cpp tinf/tdeflate.cpp -lz -ldeflate -o decompress_bench
+ *  ./decompress_bench [file.aseprite ...]
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "aseprite.h"
+#include "decompressor.h"
+
+#ifdef ASEPRITE_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace aseprite;
+
+struct Stream {
+    std::vector<uint8_t> compressed;
+    uint32_t uncompressedLen;
+};
+
+// passes the streams through to tinf and keeps a copy of each of them
+class RecordingDecompressor : public Decompressor {
+public:
+    mutable std::vector<Stream> streams;
+
+    using Decompressor::uncompress;
+
+    const char * name() const override {
+        return "recording";
+    }
+
+    bool uncompress(uint8_t * dest, uint32_t destCapacity, uint32_t & destLen,
+                    const uint8_t * source, uint32_t sourceLen) const override {
+        bool result = defaultDecompressor().uncompress(dest, destCapacity, destLen, source, sourceLen);
+        if (result) {
+            streams.push_back(Stream{std::vector<uint8_t>(source, source + sourceLen), destLen});
+        }
+        return result;
+    }
+};
+
+#ifndef ASEPRITE_WITH_ZLIB
+static uint32_t adler32(const uint8_t * data, size_t length) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < length; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+// zlib stream of stored blocks, used when no compressor is built in
+static std::vector<uint8_t> storedZlib(const std::vector<uint8_t> & data) {
+    std::vector<uint8_t> out{0x78, 0x01};
+    size_t offset = 0;
+    do {
+        uint16_t length = std::min<size_t>(65535, data.size() - offset);
+        out.push_back(offset + length == data.size());
+        out.push_back(length & 0xFF);
+        out.push_back(length >> 8);
+        out.push_back(~length & 0xFF);
+        out.push_back((~length >> 8) & 0xFF);
+        out.insert(out.end(), data.begin() + offset, data.begin() + offset + length);
+        offset += length;
+    } while (offset < data.size());
+    uint32_t adler = adler32(data.data(), data.size());
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(adler >> shift);
+    }
+    return out;
+}
+#endif
+
+static std::vector<uint8_t> compress(const std::vector<uint8_t> & data) {
+#ifdef ASEPRITE_WITH_ZLIB
+    uLongf length = compressBound(data.size());
+    std::vector<uint8_t> out(length);
+    compress2(out.data(), &length, data.data(), data.size(), Z_DEFAULT_COMPRESSION);
+    out.resize(length);
+    return out;
+#else
+    return storedZlib(data);
+#endif
+}
+
+// pixel art like RGBA: blocks of flat color with sparse noise
+static Stream syntheticSprite(uint32_t width, uint32_t height, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> pixels(size_t(width) * height * 4);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t block = ((y / 16) * 7919 + (x / 16) * 104729) ^ seed;
+            uint8_t * p = &pixels[(size_t(y) * width + x) * 4];
+            p[0] = block;
+            p[1] = block >> 8;
+            p[2] = block >> 16;
+            p[3] = (block % 3) ? 255 : 0;
+            if (random() % 64 == 0) {
+                p[0] = random();
+            }
+        }
+    }
+    return Stream{compress(pixels), static_cast<uint32_t>(pixels.size())};
+}
+
+static void run(const char * label, const Decompressor & decompressor, const std::vector<Stream> & streams, bool streamed) {
+    size_t total = 0;
+    uint32_t capacity = 0;
+    for (const auto & stream : streams) {
+        total += stream.uncompressedLen;
+        capacity = std::max(capacity, stream.uncompressedLen);
+    }
+    std::vector<uint8_t> dest(capacity);
+    const int repeats = std::max<size_t>(1, (256u << 20) / std::max<size_t>(total, 1));
+
+    std::string concatenated;
+    for (const auto & stream : streams) {
+        concatenated.append(stream.compressed.begin(), stream.compressed.end());
+    }
+    std::istringstream input(concatenated);
+
+    bool ok = true;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        input.seekg(0);
+        for (const auto & stream : streams) {
+            uint32_t destLen;
+            if (streamed) {
+                ok = decompressor.uncompress(dest.data(), stream.uncompressedLen, destLen,
+                    input, stream.compressed.size()) && ok;
+            } else {
+                ok = decompressor.uncompress(dest.data(), stream.uncompressedLen, destLen,
+                    stream.compressed.data(), stream.compressed.size()) && ok;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-24s %-12s %-8s %10.1f MB/s%s\n", label, decompressor.name(),
+        streamed ? "streamed" : "buffer", total * repeats / seconds / 1e6, ok ? "" : "  FAILED");
+}
+
+int main(int argc, char ** argv) {
+    std::vector<const Decompressor *> backends{&defaultDecompressor()};
+#ifdef ASEPRITE_WITH_ZLIB
+    static const ZlibDecompressor zlib;
+    backends.push_back(&zlib);
+#endif
+#ifdef ASEPRITE_WITH_LIBDEFLATE
+    static const LibdeflateDecompressor libdeflate;
+    backends.push_back(&libdeflate);
+#endif
+
+    std::vector<std::string> files{"mountain.aseprite", "pinkja_anim.aseprite"};
+    if (argc > 1) {
+        files.assign(argv + 1, argv + argc);
+    }
+    for (const auto & file : files) {
+        RecordingDecompressor recording;
+        ASEPRITE ase(file, recording);
+        if (recording.streams.empty()) {
+            std::printf("%-24s no compressed cels\n", file.c_str());
+            continue;
+        }
+        for (const auto * backend : backends) {
+            run(file.c_str(), *backend, recording.streams, false);
+            run(file.c_str(), *backend, recording.streams, true);
+        }
+    }
+
+    for (uint32_t size : {256u, 1024u, 4096u}) {
+        std::vector<Stream> streams{syntheticSprite(size, size, size)};
+        std::string label = "synthetic " + std::to_string(size) + "x" + std::to_string(size);
+        for (const auto * backend : backends) {
+            run(label.c_str(), *backend, streams, false);
+            run(label.c_str(), *backend, streams, true);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Synthetic sprites for benchmarks and test corpora
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#include <cstdint>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "aseprite.h"
+#include "synthetic.h"
+
+namespace synthetic {
+
+using namespace aseprite;
+
+namespace {
+
+PIXEL_DATA pixel(PIXELTYPE format, const PALETTE_CHUNK & palette, BYTE index) {
+    PIXEL_DATA p{};
+    const Color & c = palette.colors[index];
+    switch (format) {
+    case INDEXED:
+        p.INDEXED = index;
+        break;
+    case GRAYSCALE:
+        p.GRAYSCALE[0] = (c.r * 77 + c.g * 150 + c.b * 29) >> 8;
+        p.GRAYSCALE[1] = c.a;
+        break;
+    case RGBA:
+        p.RGBA[0] = c.r;
+        p.RGBA[1] = c.g;
+        p.RGBA[2] = c.b;
+        p.RGBA[3] = c.a;
+        break;
+    }
+    return p;
+}
+
+/**
+ * Produces the frames in order, frame 0 carries the palette, layers, tags and slices.
+ */
+class Generator {
+    const SpriteSpec & spec;
+    std::mt19937 random;
+    PALETTE_CHUNK palette;
+    std::vector<int32_t> lastCel; // per layer, frame of its last cel or -1
+
+    bool chance(float probability) {
+        return std::uniform_real_distribution<float>(0.0f, 1.0f)(random) < probability;
+    }
+
+    BYTE index(uint32_t x, uint32_t y, uint16_t frame, uint16_t layer) {
+        switch (spec.profile) {
+        case Profile::FLAT: {
+            // 64x64 areas
+            uint32_t area = ((y / 64) * 7919 + ((x + frame) / 64) * 104729 + layer * 31) ^ spec.seed;
+            return 1 + area % 15;
+        }
+        case Profile::PIXEL_ART: {
+            // 8x8 blocks, shifted by a pixel each frame
+            uint32_t block = ((y / 8) * 7919 + ((x + frame) / 8) * 104729 + layer * 31) ^ spec.seed;
+            BYTE index = block % 7 == 0 ? 0 : 1 + block % 15;
+            return random() % 64 == 0 ? BYTE(random()) : index;
+        }
+        case Profile::GRADIENT:
+            // palette is a ramp for this profile
+            return 1 + (x + y + frame + layer * 17) % 255;
+        case Profile::NOISE:
+        default:
+            return random();
+        }
+    }
+
+    void addHeaderChunks(FRAME & frame) {
+        PALETTE_CHUNK palette_chunk;
+        palette_chunk.colors = palette.colors;
+        frame.chunks.emplace_back(std::move(palette_chunk), PALETTE_0x2019);
+
+        for (uint16_t l = 0; l < spec.layers; l++) {
+            LAYER_CHUNK layer;
+            layer.flags = 0x1 | 0x2;
+            layer.layerType = 0;
+            layer.layerChildLevel = 0;
+            layer.width = 0;
+            layer.height = 0;
+            layer.blendMode = 0;
+            layer.opacity = 255;
+            layer.unused[0] = layer.unused[1] = layer.unused[2] = 0;
+            layer.name = STRING("layer " + std::to_string(l));
+            frame.chunks.emplace_back(std::move(layer), LAYER_0x2004);
+        }
+
+        uint16_t tags = std::min(spec.tags, spec.frames);
+        if (tags > 0) {
+            TAG_CHUNK tag_chunk;
+            for (uint16_t t = 0; t < tags; t++) {
+                TAG tag;
+                tag.from = uint32_t(spec.frames) * t / tags;
+                tag.to = uint32_t(spec.frames) * (t + 1) / tags - 1;
+                tag.direction = t % 3;
+                tag.name = STRING("tag " + std::to_string(t));
+                tag_chunk.tags.push_back(std::move(tag));
+            }
+            frame.chunks.emplace_back(std::move(tag_chunk), FRAME_TAGS_0x2018);
+        }
+
+        for (uint16_t s = 0; s < spec.slices; s++) {
+            SLICE_CHUNK slice;
+            slice.flags = s % 4; // none, 9-patch, pivot, both
+            slice.name = STRING("slice " + std::to_string(s));
+            // a key on frame 0 and then every 4 frames
+            for (uint32_t f = 0; f < spec.frames; f += 4) {
+                SLICE_KEY key{};
+                key.frame = f;
+                key.width = 1 + random() % spec.width;
+                key.height = 1 + random() % spec.height;
+                key.x = random() % (spec.width - key.width + 1);
+                key.y = random() % (spec.height - key.height + 1);
+                key.ninePatches = {1, 1, key.width / 2, key.height / 2};
+                key.pivot = {LONG(key.width / 2), LONG(key.height)};
+                slice.sliceKeys.push_back(key);
+            }
+            slice.count = slice.sliceKeys.size();
+            frame.chunks.emplace_back(std::move(slice), SLICE_0x2022);
+        }
+    }
+
+    CEL_CHUNK cel(uint16_t f, uint16_t l) {
+        CEL_CHUNK cel;
+        cel.layerIndex = l;
+        cel.opacity = 255;
+        if (lastCel[l] >= 0 && chance(spec.linkedRatio)) {
+            cel.type = 1;
+            cel.x = 0;
+            cel.y = 0;
+            cel.frameLink = lastCel[l];
+            return cel;
+        }
+        cel.type = 2;
+        cel.width = l == 0 ? spec.width : std::max(1, spec.width / 2);
+        cel.height = l == 0 ? spec.height : std::max(1, spec.height / 2);
+        cel.x = l == 0 ? 0 : (random() % (spec.width - cel.width + 1));
+        cel.y = l == 0 ? 0 : (random() % (spec.height - cel.height + 1));
+        cel.pixels.resize(size_t(cel.width) * cel.height);
+        for (uint32_t y = 0; y < cel.height; y++) {
+            for (uint32_t x = 0; x < cel.width; x++) {
+                cel.pixels[size_t(y) * cel.width + x] = pixel(spec.format, palette, index(x, y, f, l));
+            }
+        }
+        lastCel[l] = f;
+        return cel;
+    }
+
+public:
+    explicit Generator(const SpriteSpec & spec) :
+        spec(spec),
+        random(spec.seed),
+        lastCel(spec.layers, -1) {
+        for (size_t i = 0; i < palette.colors.size(); i++) {
+            uint32_t c = random();
+            BYTE a = i == 0 ? 0 : 255;
+            if (spec.profile == Profile::GRADIENT) {
+                palette.colors[i] = Color{BYTE(i), BYTE(i / 2), BYTE(255 - i), a};
+            } else {
+                palette.colors[i] = Color{BYTE(c), BYTE(c >> 8), BYTE(c >> 16), a};
+            }
+        }
+    }
+
+    ASE_HEADER header() const {
+        ASE_HEADER header{};
+        header.magicNumber = 0xA5E0;
+        header.frames = spec.frames;
+        header.width = spec.width;
+        header.height = spec.height;
+        header.bitDepth = spec.format == INDEXED ? 8 : spec.format == GRAYSCALE ? 16 : 32;
+        header.flags = 0x1;
+        header.speed = 100;
+        header.transparentIndex = 0;
+        header.colorsCount = 256;
+        header.pixelWidth = 1;
+        header.pixelHeight = 1;
+        return header;
+    }
+
+    FRAME frame(uint16_t f) {
+        FRAME frame;
+        frame.magicNumber = 0xF1FA;
+        frame.duration = 100;
+        frame.reserved[0] = frame.reserved[1] = 0;
+        if (f == 0) {
+            addHeaderChunks(frame);
+        }
+        for (uint16_t l = 0; l < spec.layers; l++) {
+            if (chance(spec.celDensity)) {
+                frame.chunks.emplace_back(cel(f, l), CEL_0x2005);
+            }
+        }
+        return frame;
+    }
+};
+
+}
+
+aseprite::ASEPRITE makeSprite(const SpriteSpec & spec) {
+    Generator generator(spec);
+    ASEPRITE ase;
+    ase.header = generator.header();
+    ase.frames.reserve(spec.frames);
+    for (uint16_t f = 0; f < spec.frames; f++) {
+        ase.frames.push_back(generator.frame(f));
+    }
+    return ase;
+}
+
+uint64_t writeSprite(const SpriteSpec & spec, const std::string & path, int level) {
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    Generator generator(spec);
+    ASE_HEADER header = generator.header();
+    bool result = file.good() && header.write(file);
+    for (uint16_t f = 0; f < spec.frames && result; f++) {
+        result = generator.frame(f).write(file, header.pixelFormat(), level);
+    }
+    uint64_t size = file.tellp();
+    // the size field is 32 bit, readers don't rely on it
+    header.fileSize = size;
+    file.seekp(0);
+    result = result && header.write(file);
+    file.close();
+    return result && !file.fail() ? size : 0;
+}
+
+}
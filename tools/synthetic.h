@@ -0,0 +1,56 @@
+/*
+ * Synthetic sprites for benchmarks and test corpora
+ * Version 0.1
+ * Copyright 2021 by Frantisek Veverka
+ *
+ */
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <cstdint>
+#include <string>
+#include "aseprite.h"
+
+namespace synthetic {
+
+/**
+ * How well the cel pixels compress.
+ */
+enum class Profile {
+    FLAT,       // large areas of one color, compresses extremely well
+    PIXEL_ART,  // 8x8 blocks of flat color with sparse noise
+    GRADIENT,   // smooth gradients, few long matches
+    NOISE       // random pixels, incompressible
+};
+
+struct SpriteSpec {
+    uint16_t width = 256;
+    uint16_t height = 256;
+    aseprite::PIXELTYPE format = aseprite::RGBA;
+    uint16_t frames = 8;
+    uint16_t layers = 2;
+    uint32_t seed = 1;
+    float celDensity = 1.0f;  // chance of a layer having a cel in a frame
+    float linkedRatio = 0.0f; // chance of a cel being linked to the previous cel of its layer
+    uint16_t tags = 0;        // loops splitting the frames evenly
+    uint16_t slices = 0;
+    Profile profile = Profile::PIXEL_ART;
+};
+
+/**
+ * Sprite held in memory: blocks of color drifting from frame to frame, one compressed cel
+ * per layer and frame (less with celDensity < 1). Layer 0 covers the canvas, the others
+ * a quarter of it. Write it out with ASEPRITE::write.
+ */
+aseprite::ASEPRITE makeSprite(const SpriteSpec & spec);
+
+/**
+ * Writes the same sprite as makeSprite one frame at a time, so files much larger than
+ * memory can be generated. Returns the file size, 0 on I/O error.
+ */
+uint64_t writeSprite(const SpriteSpec & spec, const std::string & path, int level = TDEFLATE_DEFAULT_LEVEL);
+
+}
+
+#endif